@@ -0,0 +1,31 @@
+/*
+  ==============================================================================
+
+    Counting heap allocations for the benchmark and test builds.
+
+  ==============================================================================
+*/
+
+#include "AllocationCounting.h"
+
+#include <cstdlib>
+#include <new>
+
+// Per thread, so the audio, worker and message threads only see their own   ~A
+static thread_local juce::uint64 threadAllocationCount = 0;
+
+void* operator new(std::size_t size)
+{
+    ++threadAllocationCount;
+    if (auto* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+juce::uint64 getThreadAllocationCount()
+{
+    return threadAllocationCount;
+}
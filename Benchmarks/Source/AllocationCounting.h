@@ -0,0 +1,16 @@
+/*
+  ==============================================================================
+
+    Counting heap allocations for the benchmark and test builds.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+// Heap allocations the calling thread made since it started. Compiling
+// AllocationCounting.cpp into a target replaces the global operator new and
+// delete for all of it, fine for a benchmark or a test, never for the plugin   ~A
+juce::uint64 getThreadAllocationCount();
@@ -0,0 +1,204 @@
+/*
+  ==============================================================================
+
+    Headless benchmark of the editor's drawing, built as a console app so it
+    runs without a host. Compares the PolylineRenderer with strokePath, then
+    renders the editor and the response window into offscreen images at
+    several sizes and scales while the processor gets synthetic audio, and
+    prints what every UIProfiler section cost.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+#include "AllocationCounting.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int frameRate = 60;
+    constexpr int samplesPerFrame = (int)sampleRate / frameRate;
+    constexpr int numFrames = 120;
+
+    // A sweeping sine over pink-ish noise, so every band of the analyzer moves   ~A
+    struct SyntheticAudio
+    {
+        void fill(juce::AudioBuffer<float>& buffer)
+        {
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+            {
+                const auto frequency = 40.0 * std::pow(2.0, 9.0 * sweepPosition);
+                phase += juce::MathConstants<double>::twoPi * frequency / sampleRate;
+                sweepPosition = std::fmod(sweepPosition + 1.0 / (sampleRate * 8.0), 1.0);
+
+                noise = 0.97f * noise + 0.03f * (random.nextFloat() * 2.f - 1.f);
+                const auto sample = 0.25f * (float)std::sin(phase) + noise;
+
+                for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+                    buffer.setSample(ch, i, sample);
+            }
+        }
+
+        juce::Random random{ 1234 };
+        double phase = 0, sweepPosition = 0;
+        float noise = 0;
+    };
+
+    void setParameter(EQ_LiteAudioProcessor& processor, const juce::String& parameterID, float value)
+    {
+        auto* parameter = processor.apvts.getParameter(parameterID);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    }
+
+    // Feeding a frame's worth of audio, giving the shared analyzer worker a pass
+    // to turn it into paths, then painting once at 'scale'. The window's own
+    // frame tick runs first, as the frame clock would do it   ~A
+    void benchmark(const juce::String& name, juce::Component& component, ResponseCurveWindow* window,
+                   EQ_LiteAudioProcessor& processor, SyntheticAudio& audio, float scale)
+    {
+        juce::AudioBuffer<float> buffer(2, samplesPerFrame);
+        juce::MidiBuffer midi;
+
+        UIProfiler::getReportAndReset();
+        double totalMs = 0;
+        juce::uint64 allocations = 0;
+
+        for (int frame = 0; frame < numFrames; ++frame)
+        {
+            if (window != nullptr)
+                window->frameTick();
+
+            // Nothing is on screen here, so the processor is told someone's watching   ~A
+            processor.setAnalyzerShowing(true);
+            audio.fill(buffer);
+            processor.processBlock(buffer, midi);
+            juce::Thread::sleep(AnalyzerWorker::passIntervalMs + 1);
+
+            const auto allocationsBefore = getThreadAllocationCount();
+            totalMs += UIProfiler::renderFrames(component, 1, scale);
+            allocations += getThreadAllocationCount() - allocationsBefore;
+        }
+
+        std::cout << name << " " << component.getWidth() << "x" << component.getHeight() << " at " << scale << "x: "
+                  << juce::String(totalMs / numFrames, 3) << " ms and "
+                  << juce::String((double)allocations / numFrames, 1) << " allocations per frame" << std::endl
+                  << UIProfiler::getReportAndReset() << std::endl << std::endl;
+    }
+
+    struct Measurement
+    {
+        double msPerDraw;
+        double allocationsPerDraw;
+    };
+
+    template<typename Draw>
+    Measurement measure(int numDraws, Draw&& draw)
+    {
+        const auto allocationsBefore = getThreadAllocationCount();
+        const auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numDraws; ++i)
+            draw();
+
+        const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        return { seconds * 1000.0 / numDraws, (double)(getThreadAllocationCount() - allocationsBefore) / numDraws };
+    }
+
+    // The PolylineRenderer against what paint() used to do for every trace: copy
+    // the Path, move it into place and stroke it. The widths cover the window at
+    // 1x up to wide windows at 2x, one polyline point per pixel column   ~A
+    void benchmarkPolylineRenderer()
+    {
+        constexpr int numDraws = 500;
+        constexpr int height = 300;
+        constexpr float thickness = 2.f;
+
+        for (auto width : { 600, 900, 1200, 1800, 2400, 3600 })
+        {
+            Polyline polyline((size_t)width);
+            juce::Path path;
+            for (int x = 0; x < width; ++x)
+            {
+                const auto y = (float)height * (0.5f + 0.3f * std::sin((float)x * 0.02f) + 0.1f * std::sin((float)x * 0.31f));
+                polyline[(size_t)x] = y;
+
+                if (x == 0)
+                    path.startNewSubPath(0.f, y);
+                else
+                    path.lineTo((float)x, y);
+            }
+
+            juce::Image image(juce::Image::PixelFormat::ARGB, width, height, true);
+
+            const auto renderer = measure(numDraws, [&]
+            {
+                image.clear(image.getBounds());
+                juce::Image::BitmapData pixels(image, juce::Image::BitmapData::readWrite);
+                PolylineRenderer::draw(pixels, polyline, 0, 0.f, juce::Colours::azure, thickness);
+            });
+
+            const auto stroked = measure(numDraws, [&]
+            {
+                image.clear(image.getBounds());
+                juce::Graphics g(image);
+                auto copy = path;
+                copy.applyTransform(juce::AffineTransform::translation(0.f, 5.f));
+                g.setColour(juce::Colours::azure);
+                g.strokePath(copy, juce::PathStrokeType(thickness));
+            });
+
+            std::cout << "Polyline " << width << " columns: PolylineRenderer "
+                      << juce::String(renderer.msPerDraw, 4) << " ms and " << juce::String(renderer.allocationsPerDraw, 1)
+                      << " allocations, strokePath " << juce::String(stroked.msPerDraw, 4) << " ms and "
+                      << juce::String(stroked.allocationsPerDraw, 1) << " allocations per draw, "
+                      << juce::String(stroked.msPerDraw / juce::jmax(1.0e-9, renderer.msPerDraw), 1) << "x" << std::endl;
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ignoreUnused(argc, argv);
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    UIProfiler::setAllocationCounter(getThreadAllocationCount);
+
+    // Without a host the rate has to be set by hand, prepareToPlay() doesn't   ~A
+    EQ_LiteAudioProcessor processor;
+    processor.setRateAndBufferSizeDetails(sampleRate, samplesPerFrame);
+    processor.prepareToPlay(sampleRate, samplesPerFrame);
+
+    // A curve with something in it, and every analyzer trace switched on   ~A
+    setParameter(processor, getBandParameterID(0, BandGain), 6.f);
+    setParameter(processor, getBandParameterID(1, BandGain), -9.f);
+    setParameter(processor, getBandParameterID(2, BandGain), 4.f);
+    setParameter(processor, "Analyzer Peak Hold", 1.f);
+    setParameter(processor, "Analyzer Pre EQ", 1.f);
+
+    benchmarkPolylineRenderer();
+
+    SyntheticAudio audio;
+
+    {
+        ResponseCurveWindow window(processor);
+        for (auto size : { juce::Point<int>(690, 300), juce::Point<int>(1200, 450), juce::Point<int>(1800, 650) })
+        {
+            window.setSize(size.x, size.y);
+            for (auto scale : { 1.f, 1.5f, 2.f })
+                benchmark("ResponseCurveWindow", window, &window, processor, audio, scale);
+        }
+    }
+
+    {
+        EQ_LiteAudioProcessorEditor editor(processor);
+        for (auto scale : { 1.f, 1.5f, 2.f })
+            benchmark("EQ_LiteAudioProcessorEditor", editor, nullptr, processor, audio, scale);
+    }
+
+    processor.releaseResources();
+    return 0;
+}
@@ -19,9 +19,17 @@ void LookAndFeel::drawRotarySlider(juce::Graphics& g,
 {
     using namespace juce;
 
-    // Drawing the knob circles     ~A
-    auto bounds = Rectangle<float>(x, y, width, height);
+    jassert(rotaryStartAngle < rotaryEndAngle);
+
+    auto sliderAngleRad = jmap(sliderPosProportional, 0.f, 1.f, rotaryStartAngle, rotaryEndAngle);
+    drawKnob(g, Rectangle<float>(x, y, width, height), sliderAngleRad);
+}
+
+void LookAndFeel::drawKnob(juce::Graphics& g, juce::Rectangle<float> bounds, float angle)
+{
+    using namespace juce;
 
+    // Drawing the knob circles     ~A
     g.setColour(Colour(38u, 38u, 38u));
     g.fillEllipse(bounds);
 
@@ -48,320 +56,1464 @@ void LookAndFeel::drawRotarySlider(juce::Graphics& g,
 
     p1.addRectangle(r1);
     p2.addRectangle(r2);
-    jassert(rotaryStartAngle < rotaryEndAngle);
     
-    auto sliderAngleRad = jmap(sliderPosProportional, 0.f, 1.f, rotaryStartAngle, rotaryEndAngle);
-    p1.applyTransform(AffineTransform().rotated(sliderAngleRad, center.getX(), center.getY()));
-    p2.applyTransform(AffineTransform().rotated(sliderAngleRad, center.getX(), center.getY()));
+    p1.applyTransform(AffineTransform().rotated(angle, center.getX(), center.getY()));
+    p2.applyTransform(AffineTransform().rotated(angle, center.getX(), center.getY()));
     
     g.setColour(Colour(0u, 0u, 0u));
     g.fillPath(p1);
     g.setColour(Colour(250u, 250u, 250u));
     g.fillPath(p2);
+}
+
+void LookAndFeel::drawKnobFrame(juce::Graphics& g, juce::Rectangle<int> bounds, float proportion)
+{
+    using namespace juce;
+
+    // Rendering at the physical resolution keeps the knobs sharp on HiDPI screens   ~A
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    auto size = jmin(bounds.getWidth(), bounds.getHeight());
+    if (size <= 0)
+        return;
+
+    const auto& filmstrip = getKnobFilmstrip(size, scale);
+    auto frame = roundToInt(jlimit(0.f, 1.f, proportion) * (numKnobFrames - 1));
+    auto destination = bounds.withSizeKeepingCentre(size, size).expanded(knobFrameMargin);
+
+    g.drawImage(filmstrip.frames,
+                destination.getX(), destination.getY(), destination.getWidth(), destination.getHeight(),
+                (frame % knobFramesPerRow) * filmstrip.framePixels, (frame / knobFramesPerRow) * filmstrip.framePixels,
+                filmstrip.framePixels, filmstrip.framePixels);
+}
+
+const LookAndFeel::KnobFilmstrip& LookAndFeel::getKnobFilmstrip(int size, float scale)
+{
+    using namespace juce;
+
+    for (const auto& filmstrip : knobFilmstrips)
+        if (filmstrip.size == size && approximatelyEqual(filmstrip.scale, scale))
+            return filmstrip;
+
+    // Frames in a grid rather than one long strip, so the image stays within
+    // what graphics backends accept as a texture   ~A
+    const auto frameSize = (float)(size + 2 * knobFrameMargin);
+    const auto framePixels = (int)std::ceil(frameSize * scale);
+    const auto numRows = (numKnobFrames + knobFramesPerRow - 1) / knobFramesPerRow;
+
+    Image frames(Image::PixelFormat::ARGB, framePixels * knobFramesPerRow, framePixels * numRows, true);
+    Graphics g(frames);
+
+    const auto pixelsPerUnit = (float)framePixels / frameSize;
+
+    for (int frame = 0; frame < numKnobFrames; ++frame)
+    {
+        auto x = (frame % knobFramesPerRow) * framePixels;
+        auto y = (frame / knobFramesPerRow) * framePixels;
+
+        Graphics::ScopedSaveState state(g);
+        g.reduceClipRegion(x, y, framePixels, framePixels);
+        g.addTransform(AffineTransform::scale(pixelsPerUnit).translated((float)x, (float)y));
+
+        auto angle = jmap((float)frame / (float)(numKnobFrames - 1), getKnobStartAngle(), getKnobEndAngle());
+        drawKnob(g, Rectangle<float>((float)knobFrameMargin, (float)knobFrameMargin, (float)size, (float)size), angle);
+    }
+
+    knobFilmstrips.push_back({ size, scale, framePixels, frames });
+    return knobFilmstrips.back();
+}
+
+// Drawing the toggle bypass button
+void LookAndFeel::drawToggleButton(juce::Graphics& g,
+                                   juce::ToggleButton& toggleButton,
+                                   bool shouldDrawButtonAsHighlighted,
+                                   bool ShouldDrawButtonAsDown)
+{
+    using namespace juce;
+    Path powerButton;
+    auto bounds = toggleButton.getLocalBounds();
+
+    auto size = jmin(bounds.getWidth(), bounds.getHeight()) - 6;
+    auto r = bounds.withSizeKeepingCentre(size, size).toFloat();
+
+    float ang = 30.f;
+    size -= 6;
+
+    powerButton.addCentredArc(r.getCentreX(), 
+                              r.getCentreY(), 
+                              size * 0.5, 
+                              size * 0.5, 
+                              0.f, 
+                              degreesToRadians(ang), 
+                              degreesToRadians(360.f - ang),
+                              true);
+    powerButton.startNewSubPath(r.getCentreX(), r.getY());
+    powerButton.lineTo(r.getCentre());
+
+    PathStrokeType pst(2.f, PathStrokeType::JointStyle::curved);
+
+    auto color = toggleButton.getToggleState() ? Colours::dimgrey : Colours::azure;
+
+    g.setColour(color);
+    g.strokePath(powerButton, pst);
+    g.drawEllipse(r, 1);
+}
+
+// Implementing paint function to draw the custom knobs     ~A
+void MyEQKnob1::paint(juce::Graphics& g)
+{
+    using namespace juce;
+    EQ_LITE_PROFILE_UI(KnobPaint);
+
+    auto range = getRange();
+
+    auto sliderBounds = getSliderBounds();
+
+    lnf->drawKnobFrame(g, sliderBounds, (float)jmap(getValue(), range.getStart(), range.getEnd(), 0.0, 1.0));
+
+    // Drawing the min max values for each knob     ~A
+    if (labelGlyphBounds != getLocalBounds() || numLabelsLaidOut != labelsArray.size())
+        layOutLabels();
+
+    g.setColour(Colour(220u, 220u, 220u));
+    labelGlyphs.draw(g);
+}
+
+void MyEQKnob1::layOutLabels()
+{
+    using namespace juce;
+
+    labelGlyphBounds = getLocalBounds();
+    numLabelsLaidOut = labelsArray.size();
+    labelGlyphs.clear();
+
+    auto startAngle = LookAndFeel::getKnobStartAngle();
+    auto endAngle = LookAndFeel::getKnobEndAngle();
+
+    auto sliderBounds = getSliderBounds();
+    auto knobCenter = sliderBounds.toFloat().getCentre();
+    auto radius = sliderBounds.getWidth() * 0.5f;
+    Font font((float)getTextHeight());
+
+    for (int i = 0; i < labelsArray.size(); i++)
+    {
+        auto position = labelsArray[i].position;
+        jassert(0.f <= position);
+        jassert(position <= 1.f);
+        auto angle = jmap(position, 0.f, 1.f, startAngle, endAngle);
+
+        auto c = knobCenter.getPointOnCircumference(radius + getTextHeight() * 0.5f + 1, angle);
+        Rectangle<float> r;
+        juce::String str = labelsArray[i].label;
+        r.setSize(font.getStringWidth(str), getTextHeight());
+        r.setCentre(c);
+        r.setY(r.getY() + getTextHeight());
+
+        auto area = r.toNearestInt().toFloat();
+        labelGlyphs.addFittedText(font, str, area.getX(), area.getY(), area.getWidth(), area.getHeight(),
+                                  juce::Justification::verticallyCentred, 1);
+    }
+}
+
+juce::Rectangle<int> MyEQKnob1::getSliderBounds() const
+{
+    auto bounds = getLocalBounds();
+    
+    juce::Rectangle<int> r;
+    r.setSize(70, 70);
+    r.setCentre(bounds.getCentreX(), bounds.getCentreY());
+    return r;
+}
+
+
+ResponseCurveWindow::ResponseCurveWindow(EQ_LiteAudioProcessor& p) :
+    audioProcessor(p),
+    pathProducer(audioProcessor.analyzerCapture)
     
+{
+    // Grabbing all the audio parameters and becoming a listener of them    ~A
+    const auto& parameters = audioProcessor.getParameters();
+    for (auto parameter : parameters)
+    {
+        parameter->addListener(this);
+    }
+   
+    setOpaque(true);
+
+    updateChain();
+
+    spectrogramColumn.reserve(SpectrogramColumnGenerator::maxHeight);
+
+    analyzerWorker->addClient(this);
+
+    frameClock->addClient(this);
+}
+
+ResponseCurveWindow::~ResponseCurveWindow()
+{
+    frameClock->removeClient(this);
+
+    // Waits for the worker if it's in the middle of our analysis   ~A
+    analyzerWorker->removeClient(this);
+
+    // If we registered as a listener, we have to deregister in the destructor  ~A
+    const auto& parameters = audioProcessor.getParameters();
+    for (auto parameter : parameters)
+    {
+        parameter->removeListener(this);
+    }
+
+    audioProcessor.setAnalyzerShowing(false);
+}
+
+void ResponseCurveWindow::visibilityChanged()
+{
+    updateAnalyzerShowing();
+    frameClock->wake(this);
+}
+
+void ResponseCurveWindow::parentHierarchyChanged()
+{
+    updateAnalyzerShowing();
+    frameClock->wake(this);
+}
+
+// isShowing() also turns false when the host window gets minimised, which
+// doesn't send any callback, so the frame tick keeps polling this as well   ~A
+void ResponseCurveWindow::updateAnalyzerShowing()
+{
+    audioProcessor.setAnalyzerShowing(isShowing());
+}
+
+void ResponseCurveWindow::parameterValueChanged(int parameterIndex, float newValue)
+{
+    parametersChanged.set(true);
+
+    // Knob drags come in on the message thread and get the next frame. Host automation
+    // may arrive on the audio thread, that one waits for the idle poll    ~A
+    if (juce::MessageManager::existsAndIsCurrentThread())
+    {
+        frameClock->wake(this);
+        analyzerWorker->notify();
+    }
+}
+
+AnalyzerWorker::AnalyzerWorker() : juce::Thread("EQ_Lite analyzer")
+{
+    startThread();
+}
+
+AnalyzerWorker::~AnalyzerWorker()
+{
+    stopThread(1000);
+}
+
+void AnalyzerWorker::addClient(AnalyzerClient* client)
+{
+    const juce::ScopedLock sl(clientLock);
+    clients.addIfNotAlreadyThere(client);
+}
+
+void AnalyzerWorker::removeClient(AnalyzerClient* client)
+{
+    const juce::ScopedLock sl(clientLock);
+    clients.removeFirstMatchingValue(client);
+}
+
+void AnalyzerWorker::run()
+{
+    while (!threadShouldExit())
+    {
+        const auto passStart = juce::Time::getMillisecondCounterHiRes();
+
+        // The pass runs over one copy of the list, taken in the order it starts
+        // from, so nobody gets run twice or skipped when editors come and go    ~A
+        {
+            const juce::ScopedLock sl(clientLock);
+            const auto numClients = clients.size();
+            firstClient = numClients > 0 ? firstClient % numClients : 0;
+
+            passClients.clearQuick();
+            for (int i = 0; i < numClients; ++i)
+                passClients.add(clients.getUnchecked((firstClient + i) % numClients));
+
+            firstClient = numClients > 0 ? (firstClient + 1) % numClients : 0;
+        }
+
+        // The lock is only held around one client at a time so editors can
+        // come and go without waiting for the whole pass. One removed since
+        // the copy was taken is skipped, it may already be gone    ~A
+        int numFrames = 0;
+        for (auto* client : passClients)
+        {
+            if (threadShouldExit())
+                break;
+
+            {
+                const juce::ScopedLock sl(clientLock);
+                if (clients.contains(client))
+                    numFrames += client->runAnalysis();
+            }
+
+            if (juce::Time::getMillisecondCounterHiRes() - passStart > passBudgetMs)
+                break;
+        }
+
+        const auto elapsed = juce::Time::getMillisecondCounterHiRes() - passStart;
+        wait(numFrames > 0 ? juce::jmax(1, passIntervalMs - (int)elapsed) : idleIntervalMs);
+    }
+}
+
+void FrameClock::addClient(FrameClockClient* client)
+{
+    entries.push_back({ client, 0 });
+    scheduleNextTick();
+}
+
+void FrameClock::removeClient(FrameClockClient* client)
+{
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [client](const Entry& e) { return e.client == client; }),
+                  entries.end());
+    scheduleNextTick();
+}
+
+void FrameClock::wake(FrameClockClient* client)
+{
+    for (auto& entry : entries)
+        if (entry.client == client)
+            entry.nextTickMs = 0;
+
+    scheduleNextTick();
+}
+
+void FrameClock::timerCallback()
+{
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    lastTickMs = now;
+
+    // A millisecond of slack so a client isn't pushed a whole frame back by timer jitter  ~A
+    for (size_t i = 0; i < entries.size(); ++i)
+        if (entries[i].nextTickMs <= now + 1.0)
+            entries[i].nextTickMs = now + entries[i].client->frameTick();
+
+   #if EQ_LITE_UI_PROFILING
+    if (now - lastReportMs > UIProfiler::reportIntervalMs)
+    {
+        juce::Logger::writeToLog(UIProfiler::getReportAndReset());
+        lastReportMs = now;
+    }
+   #endif
+
+    scheduleNextTick();
+}
+
+void FrameClock::scheduleNextTick()
+{
+    if (entries.empty())
+    {
+        stopTimer();
+        return;
+    }
+
+    auto nextTickMs = entries.front().nextTickMs;
+    for (const auto& entry : entries)
+        nextTickMs = juce::jmin(nextTickMs, entry.nextTickMs);
+
+    // Waking up many times within a frame still only ticks once   ~A
+    nextTickMs = juce::jmax(nextTickMs, lastTickMs + frameIntervalMs);
+
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    startTimer(juce::jmax(1, (int)(nextTickMs - now)));
+}
+
+// Installed by the benchmark and test builds, which replace operator new themselves.
+// The plugin never does, so in a plugin build this stays null   ~A
+static std::atomic<UIProfiler::AllocationCounter> allocationCounter{ nullptr };
+
+void UIProfiler::setAllocationCounter(AllocationCounter counter)
+{
+    allocationCounter.store(counter);
+}
+
+juce::uint64 UIProfiler::getAllocationCount()
+{
+    auto counter = allocationCounter.load();
+    return counter != nullptr ? counter() : 0;
+}
+
+std::array<UIProfiler::Totals, UIProfiler::NumSections>& UIProfiler::getTotals()
+{
+    static std::array<Totals, NumSections> totals;
+    return totals;
+}
+
+UIProfiler::ScopedMeasurement::ScopedMeasurement(Section sectionToMeasure) :
+    section(sectionToMeasure),
+    startTicks(juce::Time::getHighResolutionTicks()),
+    startAllocations(getAllocationCount())
+{
+}
+
+UIProfiler::ScopedMeasurement::~ScopedMeasurement()
+{
+    auto& totals = getTotals()[(size_t)section];
+    totals.calls += 1;
+    totals.ticks += juce::Time::getHighResolutionTicks() - startTicks;
+    totals.allocations += (juce::int64)(getAllocationCount() - startAllocations);
+}
+
+juce::String UIProfiler::getReportAndReset()
+{
+    static const char* const names[] = { "ResponseCurveWindow::paint", "MyEQKnob1::paint",
+                                         "PathProducer::process", "Editor background" };
+
+    juce::String report("EQ_Lite UI profile");
+    for (int i = 0; i < NumSections; ++i)
+    {
+        auto& totals = getTotals()[(size_t)i];
+        const auto calls = totals.calls.exchange(0);
+        const auto ticks = totals.ticks.exchange(0);
+        const auto allocations = totals.allocations.exchange(0);
+
+        const auto perCall = (double)juce::jmax((juce::int64)1, calls);
+        report << juce::newLine << "  " << names[i] << ": " << calls << " calls, "
+               << juce::String(juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6 / perCall, 1) << " us and "
+               << juce::String((double)allocations / perCall, 2) << " allocations per call";
+    }
+    return report;
+}
+
+double UIProfiler::renderFrames(juce::Component& component, int numFrames, float scale)
+{
+    juce::Image image(juce::Image::PixelFormat::ARGB,
+                      juce::jmax(1, juce::roundToInt(component.getWidth() * scale)),
+                      juce::jmax(1, juce::roundToInt(component.getHeight() * scale)),
+                      true);
+
+    const auto start = juce::Time::getHighResolutionTicks();
+    for (int frame = 0; frame < numFrames; ++frame)
+    {
+        juce::Graphics g(image);
+        g.addTransform(juce::AffineTransform::scale(scale));
+        component.paintEntireComponent(g, true);
+    }
+
+    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start) * 1000.0
+           / juce::jmax(1, numFrames);
+}
+
+AnalyzerSettings getAnalyzerSettings(juce::AudioProcessorValueTreeState& apvts)
+{
+    AnalyzerSettings settings;
+
+    settings.enabled = apvts.getRawParameterValue("Analyzer Enabled")->load() > 0.5f;
+    settings.overlap = (int)apvts.getRawParameterValue("Analyzer Overlap")->load();
+    settings.order = static_cast<FFTOrder>(FFTOrder::order2048 + (int)apvts.getRawParameterValue("Analyzer Resolution")->load());
+    settings.peakHold = apvts.getRawParameterValue("Analyzer Peak Hold")->load() > 0.5f;
+    settings.mode = (int)apvts.getRawParameterValue("Analyzer Mode")->load();
+    settings.showPreEQ = apvts.getRawParameterValue("Analyzer Pre EQ")->load() > 0.5f;
+
+    // Mapping the choices to bands per octave and averaging time constants   ~A
+    switch ((int)apvts.getRawParameterValue("Analyzer Smoothing")->load())
+    {
+    case Smoothing_12th: settings.smoothingBandsPerOctave = 12; break;
+    case Smoothing_6th:  settings.smoothingBandsPerOctave = 6;  break;
+    case Smoothing_3rd:  settings.smoothingBandsPerOctave = 3;  break;
+    default:             settings.smoothingBandsPerOctave = 0;  break;
+    }
+
+    switch ((int)apvts.getRawParameterValue("Analyzer Averaging")->load())
+    {
+    case Averaging_Fast:   settings.averagingSeconds = 0.1f; break;
+    case Averaging_Medium: settings.averagingSeconds = 0.3f; break;
+    case Averaging_Slow:   settings.averagingSeconds = 1.f;  break;
+    default:               settings.averagingSeconds = 0.f;  break;
+    }
+
+    return settings;
+}
+
+// log2 from the float's exponent plus a quadratic fit of the mantissa, good to
+// about 0.02 dB which is way below what the display can show   ~A
+static inline float fastPowerToDecibels(float power)
+{
+    juce::uint32 bits;
+    std::memcpy(&bits, &power, sizeof(float));
+
+    auto exponent = (float)((int)(bits >> 23) - 127);
+    bits = (bits & 0x007fffffu) | 0x3f800000u;
+
+    float mantissa;
+    std::memcpy(&mantissa, &bits, sizeof(float));
+
+    auto log2 = exponent + (-0.34484843f * mantissa + 2.02466578f) * mantissa - 0.67487759f;
+
+    // 10 * log10(2)   ~A
+    return 3.01029996f * log2;
+}
+
+SpectrumPostProcessor::SpectrumPostProcessor(int maxNumBins)
+{
+    runningPowerSum.reserve((size_t)maxNumBins + 1);
+    bandStart.reserve((size_t)maxNumBins);
+    bandEnd.reserve((size_t)maxNumBins);
+    inverseBandSize.reserve((size_t)maxNumBins);
+    average.reserve((size_t)maxNumBins);
+    peak.reserve((size_t)maxNumBins);
+}
+
+void SpectrumPostProcessor::prepare(const std::vector<float>& frequencies, int bandsPerOctave)
+{
+    smoothingBandsPerOctave = bandsPerOctave;
+    const auto numBins = frequencies.size();
+
+    runningPowerSum.assign(numBins + 1, 0.0);
+    bandStart.resize(numBins);
+    bandEnd.resize(numBins);
+    inverseBandSize.resize(numBins);
+
+    // Every bin averages the bins within half a band either side of it. The
+    // frequencies go up, so both edges only ever move forward   ~A
+    const auto halfBand = bandsPerOctave > 0 ? std::pow(2.f, 0.5f / (float)bandsPerOctave) : 1.f;
+    size_t start = 0, end = 0;
+
+    for (size_t i = 0; i < numBins; ++i)
+    {
+        while (start < i && frequencies[start] < frequencies[i] / halfBand)
+            ++start;
+        end = juce::jmax(end, i + 1);
+        while (end < numBins && frequencies[end] <= frequencies[i] * halfBand)
+            ++end;
+
+        bandStart[i] = (int)start;
+        bandEnd[i] = (int)end;
+        inverseBandSize[i] = 1.f / (float)(end - start);
+    }
+
+    if (average.size() != numBins)
+    {
+        average.resize(numBins);
+        peak.resize(numBins);
+        reset(-48.f);
+    }
+}
+
+void SpectrumPostProcessor::reset(float negativeInfinity)
+{
+    std::fill(average.begin(), average.end(), negativeInfinity);
+    std::fill(peak.begin(), peak.end(), negativeInfinity);
+    lastProcessTime = 0;
+}
+
+void SpectrumPostProcessor::process(const std::vector<float>& magnitudes,
+                                    float normalizationDB,
+                                    float averagingSeconds,
+                                    float negativeInfinity)
+{
+    const auto numBins = (int)average.size();
+    jassert((int)magnitudes.size() >= numBins);
+
+    // The ballistics follow real time, however irregularly the frames come in   ~A
+    const auto now = juce::Time::getMillisecondCounterHiRes() * 0.001;
+    const auto elapsed = lastProcessTime > 0 ? juce::jlimit(0.0, 1.0, now - lastProcessTime) : 0.0;
+    lastProcessTime = now;
+
+    const auto keep = averagingSeconds > 0.f ? (float)std::exp(-elapsed / averagingSeconds) : 0.f;
+    const auto peakDrop = (float)(peakDecayDBPerSecond * elapsed);
+
+    // Scaling the magnitudes is just an offset once we're in decibels   ~A
+    const auto offsetDB = normalizationDB;
+    const auto smoothing = smoothingBandsPerOctave > 0;
+
+    if (smoothing)
+    {
+        for (int i = 0; i < numBins; ++i)
+            runningPowerSum[(size_t)i + 1] = runningPowerSum[(size_t)i] + (double)magnitudes[(size_t)i] * magnitudes[(size_t)i];
+    }
+
+    const auto* mags = magnitudes.data();
+    const auto* sums = runningPowerSum.data();
+    const auto* starts = bandStart.data();
+    const auto* ends = bandEnd.data();
+    const auto* inverseSizes = inverseBandSize.data();
+    auto* averages = average.data();
+    auto* peaks = peak.data();
+
+    for (int i = 0; i < numBins; ++i)
+    {
+        auto power = smoothing ? (float)((sums[ends[i]] - sums[starts[i]]) * inverseSizes[i])
+                               : mags[i] * mags[i];
+
+        auto db = juce::jmax(negativeInfinity, fastPowerToDecibels(power + 1.0e-20f) + offsetDB);
+        auto averaged = db + keep * (averages[i] - db);
+
+        averages[i] = averaged;
+        peaks[i] = juce::jmax(averaged, peaks[i] - peakDrop);
+    }
+}
+
+HalfBandDecimator::HalfBandDecimator()
+{
+    // Windowed sinc cut off at a quarter of the sample rate   ~A
+    std::array<float, numTaps> window;
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), (size_t)numTaps,
+                                                             juce::dsp::WindowingFunction<float>::blackman, false);
+
+    constexpr int centre = numTaps / 2;
+    int numFound = 0;
+    float sum = 0.f;
+
+    for (int n = 0; n < numTaps; ++n)
+    {
+        auto m = n - centre;
+        if (m != 0 && m % 2 == 0)
+            continue;
+
+        auto sinc = m == 0 ? 0.5 : std::sin(juce::MathConstants<double>::halfPi * m) / (juce::MathConstants<double>::pi * m);
+        tapIndices[(size_t)numFound] = n;
+        tapGains[(size_t)numFound] = (float)sinc * window[(size_t)n];
+        sum += tapGains[(size_t)numFound];
+        ++numFound;
+    }
+    jassert(numFound == numNonZeroTaps);
+
+    // Unity gain at DC so every stage shows the same level   ~A
+    for (auto& gain : tapGains)
+        gain /= sum;
+
+    reset();
+}
+
+void HalfBandDecimator::reset()
+{
+    delayLine.fill(0.f);
+    newest = 0;
+    oddSample = false;
+}
+
+int HalfBandDecimator::process(const float* input, int numSamples, float* output)
+{
+    int numOutputs = 0;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        newest = (newest == 0 ? numTaps : newest) - 1;
+        delayLine[(size_t)newest] = delayLine[(size_t)(newest + numTaps)] = input[i];
+
+        oddSample = !oddSample;
+        if (!oddSample)
+            continue;
+
+        const auto* taps = delayLine.data() + newest;
+        float y = 0.f;
+        for (int t = 0; t < numNonZeroTaps; ++t)
+            y += tapGains[(size_t)t] * taps[tapIndices[(size_t)t]];
+
+        // Never ahead of the input we've read, so writing in place is fine  ~A
+        output[numOutputs++] = y;
+    }
+
+    return numOutputs;
+}
+
+void PolylineRenderer::draw(juce::Image::BitmapData& pixels,
+                            const Polyline& polyline,
+                            int left,
+                            float top,
+                            juce::Colour colour,
+                            float thickness)
+{
+    jassert(pixels.pixelFormat == juce::Image::ARGB);
+
+    const auto source = colour.getPixelARGB();
+    const auto halfThickness = thickness * 0.5f;
+    const auto numColumns = (int)polyline.size();
+
+    auto isDrawn = [&polyline, numColumns](int column)
+    {
+        return column >= 0 && column < numColumns && std::isfinite(polyline[(size_t)column]);
+    };
+
+    for (int column = 0; column < numColumns; ++column)
+    {
+        const auto x = left + column;
+        if (x < 0 || x >= pixels.width || !isDrawn(column))
+            continue;
+
+        // The line enters and leaves this column halfway to its neighbours, an end
+        // of the line just stops at its own y   ~A
+        const auto y = polyline[(size_t)column];
+        const auto yLeft = isDrawn(column - 1) ? 0.5f * (polyline[(size_t)column - 1] + y) : y;
+        const auto yRight = isDrawn(column + 1) ? 0.5f * (y + polyline[(size_t)column + 1]) : y;
+
+        const auto spanTop = top + juce::jmin(y, yLeft, yRight) - halfThickness;
+        const auto spanBottom = top + juce::jmax(y, yLeft, yRight) + halfThickness;
+
+        const auto firstRow = juce::jmax(0, (int)std::floor(spanTop));
+        const auto lastRow = juce::jmin(pixels.height - 1, (int)std::ceil(spanBottom) - 1);
+
+        for (int row = firstRow; row <= lastRow; ++row)
+        {
+            const auto coverage = juce::jmin(spanBottom, (float)row + 1.f) - juce::jmax(spanTop, (float)row);
+            if (coverage <= 0.f)
+                continue;
+
+            auto* pixel = reinterpret_cast<juce::PixelARGB*>(pixels.getPixelPointer(x, row));
+            pixel->blend(source, (juce::uint32)juce::roundToInt(coverage * 255.f));
+        }
+    }
+}
+
+SpectrogramColumnGenerator::SpectrogramColumnGenerator()
+{
+    // Silence is black, then blue, purple, red and yellow up to white at 0 dB   ~A
+    juce::ColourGradient gradient(juce::Colours::black, 0.f, 0.f, juce::Colours::white, 1.f, 0.f, false);
+    gradient.addColour(0.25, juce::Colours::darkblue);
+    gradient.addColour(0.5, juce::Colours::purple);
+    gradient.addColour(0.7, juce::Colours::red);
+    gradient.addColour(0.88, juce::Colours::yellow);
+    gradient.createLookupTable(colourTable.data(), colourTableSize);
+
+    workingColumn.reserve(maxHeight);
+    columnFifo.prepareSlots([](std::vector<juce::PixelARGB>& slot) { slot.reserve(maxHeight); });
+}
+
+void SpectrogramColumnGenerator::generateColumn(const std::vector<float>& renderData,
+                                                const std::vector<float>& frequencies,
+                                                int layoutVersion,
+                                                int height,
+                                                float negativeInfinity)
+{
+    height = juce::jmin(height, maxHeight);
+    if (frequencies.empty() || height <= 0)
+        return;
+
+    if (!rowMap.isUpToDate(height, layoutVersion))
+        rowMap.update(frequencies, height, layoutVersion);
+
+    workingColumn.resize((size_t)height);
+
+    const auto scale = (colourTableSize - 1) / -negativeInfinity;
+    const auto black = colourTable[0];
+
+    // Row 0 is the top of the image, so the rows run down from 20 kHz   ~A
+    for (int row = 0; row < height; ++row)
+    {
+        float value;
+        if (!rowMap.getValue(renderData, height - 1 - row, value))
+        {
+            workingColumn[(size_t)row] = black;
+            continue;
+        }
+
+        auto index = juce::jlimit(0, colourTableSize - 1, (int)((value - negativeInfinity) * scale));
+        workingColumn[(size_t)row] = colourTable[(size_t)index];
+    }
+
+    columnFifo.push(workingColumn);
+}
+
+SpectrogramDisplay::SpectrogramDisplay()
+{
+    // Nothing behind us needs painting when we scroll   ~A
+    setOpaque(true);
+}
+
+juce::Rectangle<int> SpectrogramDisplay::getImageArea() const
+{
+    // Lined up with the analyzer traces above. Those are drawn from the left edge
+    // of the analysis area and are 20 px narrower than it   ~A
+    auto bounds = getLocalBounds();
+    bounds.removeFromLeft(35);
+    bounds.removeFromRight(35 + 20);
+    bounds.removeFromTop(4);
+    bounds.removeFromBottom(8);
+
+    return bounds;
+}
+
+void SpectrogramDisplay::resized()
+{
+    auto area = getImageArea();
+
+    ring = juce::Image(juce::Image::PixelFormat::ARGB, juce::jmax(1, area.getWidth()), juce::jmax(1, area.getHeight()), true);
+    writeColumn = 0;
+    columnHeight.store(area.getHeight());
+}
+
+void SpectrogramDisplay::clear()
+{
+    ring.clear(ring.getBounds(), juce::Colours::black);
+    writeColumn = 0;
+    repaint(getImageArea());
+}
+
+void SpectrogramDisplay::pushColumn(const std::vector<juce::PixelARGB>& column)
+{
+    // A column made for the old size before a resize, just skipping it   ~A
+    if ((int)column.size() != ring.getHeight())
+        return;
+
+    {
+        juce::Image::BitmapData bitmap(ring, writeColumn, 0, 1, ring.getHeight(), juce::Image::BitmapData::writeOnly);
+
+        for (int row = 0; row < bitmap.height; ++row)
+            *reinterpret_cast<juce::PixelARGB*>(bitmap.getLinePointer(row)) = column[(size_t)row];
+    }
+
+    writeColumn = (writeColumn + 1) % ring.getWidth();
+    repaint(getImageArea());
+}
+
+void SpectrogramDisplay::paint(juce::Graphics& g)
+{
+    using namespace juce;
+    g.fillAll(Colours::black);
+
+    auto area = getImageArea();
+    auto width = ring.getWidth();
+    auto height = ring.getHeight();
+
+    // Oldest column on the left. The columns from writeColumn on are older than
+    // the ones before it, so they go first   ~A
+    auto olderPart = width - writeColumn;
+    g.drawImage(ring, area.getX(), area.getY(), olderPart, height, writeColumn, 0, olderPart, height);
+    if (writeColumn > 0)
+        g.drawImage(ring, area.getX() + olderPart, area.getY(), writeColumn, height, 0, 0, writeColumn, height);
+
+    g.setColour(Colours::burlywood);
+    g.drawRoundedRectangle(area.toFloat().expanded(2.f), 4.f, 1.f);
+}
+
+PathProducer::PathProducer(SampleRingBuffer& captureRing) :
+    captureFifo(&captureRing)
+{
+    for (auto& stage : stages)
+    {
+        stage.history.allocate(NumAnalyzedChannels, SampleRingBuffer::maxAnalysisWindow + chunkSize);
+        stage.history.prepare(chunkSize);
+        stage.fftData.assign(Generator::slotSize * NumSpectrumSlots, 0.f);
+    }
+
+    for (size_t ch = 0; ch < chunks.size(); ++ch)
+    {
+        chunks[ch].resize(chunkSize);
+        chunkPointers[ch] = chunks[ch].data();
+    }
+    preEQRightChunk.resize(chunkSize);
+
+    // Enough room for the finest resolution, so switching never reallocates   ~A
+    const auto maxNumBins = numStages * Generator::maxFFTSize / 2;
+    stitchedFrequencies.reserve(maxNumBins);
+    for (auto& trace : traces)
+        trace.stitchedData.reserve(maxNumBins);
+    preEQTrace.stitchedData.reserve(maxNumBins);
+    postEQSumData.reserve(maxNumBins);
+    differenceData.reserve(maxNumBins);
+    spectrogramData.reserve(maxNumBins);
+    for (auto* spectrum : { &published.averages[0], &published.averages[1], &published.peaks[0], &published.peaks[1], &published.preEQ })
+        spectrum->reserve(maxNumBins);
+}
+
+void PathProducer::reset()
+{
+    readPosition = captureFifo->getWritePosition();
+
+    for (auto& decimators : baseDecimators)
+        for (auto& decimator : decimators)
+            decimator.reset();
+
+    for (auto& stage : stages)
+    {
+        for (auto& decimator : stage.decimators)
+            decimator.reset();
+        stage.history.restart();
+        stage.frameEnd = stage.history.getWritePosition();
+    }
+
+    for (auto& trace : traces)
+        trace.postProcessor.reset(-48.f);
+    preEQTrace.postProcessor.reset(-48.f);
+    postEQSumProcessor.reset(-48.f);
+
+    // The message thread may have dropped its paths meanwhile, so the next ones go out regardless  ~A
+    published.layoutVersion = -1;
+}
+
+bool PathProducer::pullLatestPaths()
+{
+    // While there are paths that can be pulled, pull as many as possible,
+    // we can only display the most recent path ~A
+    bool gotNewPath = false;
+
+    for (auto& trace : traces)
+    {
+        while (trace.pathProducer.getNumPathsAvailable())
+            gotNewPath = trace.pathProducer.getPath(trace.path) || gotNewPath;
+
+        while (trace.peakPathProducer.getNumPathsAvailable())
+            trace.peakPathProducer.getPath(trace.peakPath);
+    }
+
+    while (preEQTrace.pathProducer.getNumPathsAvailable())
+        preEQTrace.pathProducer.getPath(preEQTrace.path);
+
+    while (differencePathProducer.getNumPathsAvailable())
+        differencePathProducer.getPath(differencePath);
+
+    return gotNewPath;
+}
+
+void PathProducer::clearPaths()
+{
+    for (auto& trace : traces)
+    {
+        trace.path.clear();
+        trace.peakPath.clear();
+    }
+
+    preEQTrace.path.clear();
+    differencePath.clear();
+}
+
+void PathProducer::updateLayout(double sampleRate, FFTOrder order)
+{
+    layoutSampleRate = sampleRate;
+    ++layoutVersion;
+
+    // Queued frames of the old order get dropped on the way   ~A
+    for (auto& stage : stages)
+        stage.fftDataGenerator.changeOrder(order);
+
+    const auto fftSize = stages[0].fftDataGenerator.getFFTSize();
+
+    // Decimating up front for as long as stage 0 still reaches 20 kHz   ~A
+    numBaseDecimations = 0;
+    while (numBaseDecimations < maxBaseDecimations
+           && sampleRate / (1 << (numBaseDecimations + 2)) * HalfBandDecimator::usableBandwidth >= 20000.0)
+    {
+        ++numBaseDecimations;
+    }
+
+    auto getStageRate = [this, sampleRate](int stage) { return sampleRate / (1 << (numBaseDecimations + stage)); };
+
+    // A decimated stage is only trusted up to its usable bandwidth   ~A
+    auto getUpperEdge = [this, &getStageRate](int stage)
+    {
+        auto nyquist = getStageRate(stage) * 0.5;
+        if (stage == 0)
+            return juce::jmin(20000.0, numBaseDecimations == 0 ? nyquist : nyquist * HalfBandDecimator::usableBandwidth);
+        return nyquist * HalfBandDecimator::usableBandwidth;
+    };
+
+    stitchedFrequencies.clear();
+
+    for (int s = numStages - 1; s >= 0; --s)
+    {
+        auto& stage = stages[(size_t)s];
+        auto binWidth = getStageRate(s) / fftSize;
+        auto lowerEdge = s == numStages - 1 ? 20.0 : getUpperEdge(s + 1);
+        auto upperEdge = getUpperEdge(s);
+
+        // The top stage includes its upper edge so 20 kHz itself makes it on screen  ~A
+        auto endBin = s == 0 ? (int)std::floor(upperEdge / binWidth) + 1 : (int)std::ceil(upperEdge / binWidth);
+        stage.firstBin = (int)std::ceil(lowerEdge / binWidth);
+        stage.numBins = juce::jmax(0, juce::jmin(endBin, fftSize / 2) - stage.firstBin);
+
+        for (int bin = stage.firstBin; bin < stage.firstBin + stage.numBins; ++bin)
+            stitchedFrequencies.push_back((float)(bin * binWidth));
+
+        std::fill(stage.fftData.begin(), stage.fftData.end(), 0.f);
+    }
+
+    // Forcing the smoothing bands to be rebuilt for the new bins   ~A
+    for (auto* trace : { &traces[0], &traces[1], &preEQTrace })
+    {
+        trace->stitchedData.assign(stitchedFrequencies.size(), 0.f);
+        trace->postProcessor.prepare(stitchedFrequencies, trace->postProcessor.getBandsPerOctave());
+    }
+
+    postEQSumData.assign(stitchedFrequencies.size(), 0.f);
+    postEQSumProcessor.prepare(stitchedFrequencies, postEQSumProcessor.getBandsPerOctave());
+    differenceData.assign(stitchedFrequencies.size(), 0.f);
+    spectrogramData.assign(stitchedFrequencies.size(), 0.f);
+
+    for (auto* spectrum : { &published.averages[0], &published.averages[1], &published.peaks[0], &published.peaks[1], &published.preEQ })
+        spectrum->assign(stitchedFrequencies.size(), -48.f);
+
+    reset();
+}
+
+// All channels go through identical decimators, so they always come out with
+// the same number of samples and each history gets one write per chunk   ~A
+void PathProducer::pushIntoStages(int numSamples)
+{
+    auto decimate = [this](ChannelDecimators& decimators, int numInputs)
+    {
+        int numOutputs = 0;
+        for (int ch = 0; ch < numAnalyzedChannels; ++ch)
+            numOutputs = decimators[(size_t)ch].process(chunkPointers[(size_t)ch], numInputs, chunkPointers[(size_t)ch]);
+        return numOutputs;
+    };
+
+    for (int i = 0; i < numBaseDecimations; ++i)
+        numSamples = decimate(baseDecimators[(size_t)i], numSamples);
+
+    stages[0].history.write(chunkPointers.data(), numAnalyzedChannels, numSamples);
+
+    for (int s = 1; s < numStages; ++s)
+    {
+        auto& stage = stages[(size_t)s];
+        numSamples = decimate(stage.decimators, numSamples);
+        stage.history.write(chunkPointers.data(), numAnalyzedChannels, numSamples);
+    }
+}
+
+void PathProducer::stitchStages(int slot, std::vector<float>& destination)
+{
+    auto output = destination.begin();
+    const auto offset = slot * Generator::slotSize;
+
+    for (int s = numStages - 1; s >= 0; --s)
+    {
+        const auto& stage = stages[(size_t)s];
+        auto source = stage.fftData.begin() + offset + stage.firstBin;
+        output = std::copy(source, source + stage.numBins, output);
+    }
+}
+
+int PathProducer::process(juce::Rectangle<float> fftBounds, int spectrogramHeight, double sampleRate, const AnalyzerSettings& settings)
+{
+    EQ_LITE_PROFILE_UI(PathProducerProcess);
+    const auto order = settings.order;
+
+    if (!captureFifo->isPrepared())
+        return 0;
+
+    // Switching the resolution happens right here on the worker, between two frames  ~A
+    if (sampleRate != layoutSampleRate || order != stages[0].fftDataGenerator.getOrder())
+        updateLayout(sampleRate, order);
+
+    // The audio thread restarted the capture, whatever we were tracking is stale   ~A
+    const auto channelsNeeded = settings.showPreEQ ? NumAnalyzedChannels : AnalyzedPreEQ;
+
+    if (fifoGeneration != captureFifo->getGeneration() || channelsNeeded != numAnalyzedChannels)
+    {
+        fifoGeneration = captureFifo->getGeneration();
+        numAnalyzedChannels = channelsNeeded;
+        reset();
+    }
+
+    if (settings.mode != analyzerMode)
+    {
+        analyzerMode = settings.mode;
+        for (auto& trace : traces)
+            trace.postProcessor.reset(-48.f);
+    }
+
+    // The decimators need every sample, so everything new in the capture ring goes
+    // through them. If we fell far behind we just pick up from half a ring back  ~A
+    const auto writePosition = captureFifo->getWritePosition();
+    const auto maxLag = (juce::int64)(captureFifo->getCapacity() / 2);
+
+    if (writePosition < readPosition)
+        readPosition = writePosition;
+    else if (writePosition - readPosition > maxLag)
+        readPosition = writePosition - maxLag;
+
+    while (readPosition < writePosition)
+    {
+        auto numSamples = (int)juce::jmin((juce::int64)chunkSize, writePosition - readPosition);
+        readPosition += numSamples;
+
+        // All channels or none, their histories have to stay in step   ~A
+        bool gotChunk = captureFifo->read(CaptureChannel::PostEQLeft, chunkPointers[AnalyzedLeft], numSamples, readPosition)
+                     && captureFifo->read(CaptureChannel::PostEQRight, chunkPointers[AnalyzedRight], numSamples, readPosition);
+
+        if (gotChunk && numAnalyzedChannels > AnalyzedPreEQ)
+        {
+            gotChunk = captureFifo->read(CaptureChannel::PreEQLeft, chunkPointers[AnalyzedPreEQ], numSamples, readPosition)
+                    && captureFifo->read(CaptureChannel::PreEQRight, preEQRightChunk.data(), numSamples, readPosition);
+
+            juce::FloatVectorOperations::add(chunkPointers[AnalyzedPreEQ], preEQRightChunk.data(), numSamples);
+        }
+
+        if (gotChunk)
+            pushIntoStages(numSamples);
+    }
 
-}
+    // Frames sit on a fixed hop grid set by the overlap, no matter how big the
+    // host's blocks are. The display only ever shows the newest frame, so when
+    // several hops have gone by since the last pass we skip straight to it.
+    // Decimated stages have longer hops in real time and simply update less often  ~A
+    int numFrames = 0;
+    bool gotNewData = false;
+    const auto withPreEQ = numAnalyzedChannels > AnalyzedPreEQ;
 
-// Drawing the toggle bypass button
-void LookAndFeel::drawToggleButton(juce::Graphics& g,
-                                   juce::ToggleButton& toggleButton,
-                                   bool shouldDrawButtonAsHighlighted,
-                                   bool ShouldDrawButtonAsDown)
-{
-    using namespace juce;
-    Path powerButton;
-    auto bounds = toggleButton.getLocalBounds();
+    for (auto& stage : stages)
+    {
+        const auto hopSize = getAnalyzerHopSize(stage.fftDataGenerator.getFFTSize(), settings.overlap);
+        const auto historyEnd = stage.history.getWritePosition();
 
-    auto size = jmin(bounds.getWidth(), bounds.getHeight()) - 6;
-    auto r = bounds.withSizeKeepingCentre(size, size).toFloat();
+        if (historyEnd < stage.frameEnd)
+            stage.frameEnd = historyEnd;
 
-    float ang = 30.f;
-    size -= 6;
+        const auto numHopsDue = (historyEnd - stage.frameEnd) / hopSize;
+        if (numHopsDue > 0)
+        {
+            stage.frameEnd += numHopsDue * hopSize;
+            if (stage.fftDataGenerator.produceFFTDataForRendering(stage.history, stage.frameEnd, analyzerMode, withPreEQ))
+                ++numFrames;
+        }
 
-    powerButton.addCentredArc(r.getCentreX(), 
-                              r.getCentreY(), 
-                              size * 0.5, 
-                              size * 0.5, 
-                              0.f, 
-                              degreesToRadians(ang), 
-                              degreesToRadians(360.f - ang),
-                              true);
-    powerButton.startNewSubPath(r.getCentreX(), r.getY());
-    powerButton.lineTo(r.getCentre());
+        while (stage.fftDataGenerator.getNumAvailableFFTDataBlokcs() > 0)
+            gotNewData = stage.fftDataGenerator.getFFTData(stage.fftData) || gotNewData;
+    }
 
-    PathStrokeType pst(2.f, PathStrokeType::JointStyle::curved);
+    // If any stage has new data, glueing them together, applying the ballistics
+    // and generating the paths  ~A
+    if (gotNewData)
+    {
+        // All stages use the same FFT size, so they share the normalization   ~A
+        const auto numBins = stages[0].fftDataGenerator.getFFTSize() / 2;
+        const auto normalizationDB = -juce::Decibels::gainToDecibels((float)numBins);
 
-    auto color = toggleButton.getToggleState() ? Colours::dimgrey : Colours::azure;
+        auto postProcess = [&](std::vector<float>& data, SpectrumPostProcessor& postProcessor, int slot)
+        {
+            stitchStages(slot, data);
 
-    g.setColour(color);
-    g.strokePath(powerButton, pst);
-    g.drawEllipse(r, 1);
-}
+            if (settings.smoothingBandsPerOctave != postProcessor.getBandsPerOctave())
+                postProcessor.prepare(stitchedFrequencies, settings.smoothingBandsPerOctave);
 
-// Implementing paint function to draw the custom knobs     ~A
-void MyEQKnob1::paint(juce::Graphics& g)
-{
-    using namespace juce;
-    
+            postProcessor.process(data, normalizationDB, settings.averagingSeconds, -48.f);
+        };
 
-    // Making the knobs have starting value at 7 o'clock and ending value at 5 o'clock  ~A
-    auto startAngle = degreesToRadians(180.f + 45.f);
-    auto endAngle = degreesToRadians(180.f - 45.f) + MathConstants<float>::twoPi;
+        const auto numTraces = getAnalyzerNumTraces(analyzerMode);
 
-    auto range = getRange();
+        for (int t = 0; t < numTraces; ++t)
+        {
+            auto& trace = traces[(size_t)t];
+            postProcess(trace.stitchedData, trace.postProcessor, FirstTraceSpectrum + t);
+        }
 
-    auto sliderBounds = getSliderBounds();
+        if (withPreEQ)
+        {
+            postProcess(preEQTrace.stitchedData, preEQTrace.postProcessor, PreEQSpectrum);
 
-   /* g.setColour(Colours::red);
-    g.drawRect(getLocalBounds());
-    g.setColour(Colours::orangered);
-    g.drawRect(sliderBounds);*/
-
-    getLookAndFeel().drawRotarySlider(g,
-                                      sliderBounds.getX(),
-                                      sliderBounds.getY(),
-                                      sliderBounds.getWidth(),
-                                      sliderBounds.getHeight(),
-                                      jmap(getValue(), range.getStart(), range.getEnd(), 0.0, 1.0),
-                                      startAngle,
-                                      endAngle,
-                                      *this);
+            // In Sum mode the first trace is the output sum already   ~A
+            if (analyzerMode != AnalyzerMode::Mode_Sum)
+                postProcess(postEQSumData, postEQSumProcessor, PostEQSumSpectrum);
+        }
 
-    // Drawing the min max values for each knob     ~A
-    auto knobCenter = sliderBounds.toFloat().getCentre();
-    auto radius = sliderBounds.getWidth() * 0.5f;
-    g.setColour(Colour(220u, 220u, 220u));
-    g.setFont(getTextHeight());
-    for (int i = 0; i < labelsArray.size(); i++)
-    {
-        auto position = labelsArray[i].position;
-        jassert(0.f <= position);
-        jassert(position <= 1.f);
-        auto angle = jmap(position, 0.f, 1.f, startAngle, endAngle);
+        // The spectrogram moves on with time even when the spectrum stands still   ~A
+        const auto& firstAverage = traces[0].postProcessor.getAverage();
+        const auto& secondAverage = traces[(size_t)numTraces - 1].postProcessor.getAverage();
+        for (size_t i = 0; i < spectrogramData.size(); ++i)
+            spectrogramData[i] = juce::jmax(firstAverage[i], secondAverage[i]);
 
-        auto c = knobCenter.getPointOnCircumference(radius + getTextHeight() * 0.5f + 1, angle);
-        Rectangle<float> r;
-        juce::String str = labelsArray[i].label;
-        r.setSize(g.getCurrentFont().getStringWidth(str), getTextHeight());
-        r.setCentre(c);
-        r.setY(r.getY() + getTextHeight());
+        spectrogramColumns.generateColumn(spectrogramData, stitchedFrequencies, layoutVersion, spectrogramHeight, -48.f);
 
-        g.drawFittedText(str, r.toNearestInt(), juce::Justification::verticallyCentred, 1);
+        if (needsPublishing(fftBounds, settings, numTraces, withPreEQ))
+        {
+            for (int t = 0; t < numTraces; ++t)
+            {
+                auto& trace = traces[(size_t)t];
+                trace.pathProducer.generatePath(trace.postProcessor.getAverage(), stitchedFrequencies, layoutVersion, fftBounds, -48.f);
+
+                if (settings.peakHold)
+                    trace.peakPathProducer.generatePath(trace.postProcessor.getPeak(), stitchedFrequencies, layoutVersion, fftBounds, -48.f);
+            }
+
+            if (withPreEQ)
+            {
+                preEQTrace.pathProducer.generatePath(preEQTrace.postProcessor.getAverage(), stitchedFrequencies, layoutVersion, fftBounds, -48.f);
+                produceDifference(fftBounds);
+            }
+        }
     }
 
-   
+    return numFrames;
 }
 
-juce::Rectangle<int> MyEQKnob1::getSliderBounds() const
+// True if the paths should be generated again: something about how they're drawn
+// changed, or some bin of what's shown moved by more than changeThresholdDB since
+// the last paths went out. Otherwise the message thread gets nothing new and can
+// slow down, see ResponseCurveWindow::frameTick()   ~A
+bool PathProducer::needsPublishing(juce::Rectangle<float> fftBounds, const AnalyzerSettings& settings, int numTraces, bool withPreEQ)
 {
-    auto bounds = getLocalBounds();
-    
-    juce::Rectangle<int> r;
-    r.setSize(70, 70);
-    r.setCentre(bounds.getCentreX(), bounds.getCentreY());
-    return r;
-}
+    const auto drawingChanged = fftBounds != published.bounds
+                             || layoutVersion != published.layoutVersion
+                             || analyzerMode != published.mode
+                             || settings.peakHold != published.peakHold
+                             || withPreEQ != published.withPreEQ;
 
+    // Every spectrum shown on screen, with the copy it was last published as   ~A
+    std::array<std::pair<const std::vector<float>*, std::vector<float>*>, 5> shown;
+    int numShown = 0;
 
-ResponseCurveWindow::ResponseCurveWindow(EQ_LiteAudioProcessor& p) :
-    audioProcessor(p),
-    leftPathProducer(audioProcessor.leftChannelFifo),
-    rightPathProducer(audioProcessor.rightChannelFifo)
-    
-{
-    // Grabbing all the audio parameters and becoming a listener of them    ~A
-    const auto& parameters = audioProcessor.getParameters();
-    for (auto parameter : parameters)
+    for (int t = 0; t < numTraces; ++t)
     {
-        parameter->addListener(this);
+        shown[(size_t)numShown++] = { &traces[(size_t)t].postProcessor.getAverage(), &published.averages[(size_t)t] };
+        if (settings.peakHold)
+            shown[(size_t)numShown++] = { &traces[(size_t)t].postProcessor.getPeak(), &published.peaks[(size_t)t] };
     }
-   
-    updateChain();
 
-    startTimerHz(60);
-}
+    if (withPreEQ)
+        shown[(size_t)numShown++] = { &preEQTrace.postProcessor.getAverage(), &published.preEQ };
 
-ResponseCurveWindow::~ResponseCurveWindow()
-{
-    // If we registered as a listener, we have to deregister in the destructor  ~A
-    const auto& parameters = audioProcessor.getParameters();
-    for (auto parameter : parameters)
+    auto changed = drawingChanged;
+
+    for (int i = 0; i < numShown && !changed; ++i)
     {
-        parameter->removeListener(this);
+        const auto& current = *shown[(size_t)i].first;
+        const auto& last = *shown[(size_t)i].second;
+
+        float maxChange = 0.f;
+        for (size_t bin = 0; bin < current.size(); ++bin)
+            maxChange = juce::jmax(maxChange, std::abs(current[bin] - last[bin]));
+
+        changed = maxChange > changeThresholdDB;
     }
+
+    if (!changed)
+        return false;
+
+    for (int i = 0; i < numShown; ++i)
+        std::copy(shown[(size_t)i].first->begin(), shown[(size_t)i].first->end(), shown[(size_t)i].second->begin());
+
+    published.bounds = fftBounds;
+    published.layoutVersion = layoutVersion;
+    published.mode = analyzerMode;
+    published.peakHold = settings.peakHold;
+    published.withPreEQ = withPreEQ;
+
+    return true;
 }
 
-void ResponseCurveWindow::parameterValueChanged(int parameterIndex, float newValue)
+// Both sides went through the same ballistics, so their difference is smoothed
+// and averaged the same way. It's drawn on the response curve's -24 to +24 dB
+// scale, which is the analyzer's -48 to 0 dB scale shifted by 24 dB   ~A
+void PathProducer::produceDifference(juce::Rectangle<float> fftBounds)
 {
-    parametersChanged.set(true);
+    const auto& output = analyzerMode == AnalyzerMode::Mode_Sum ? traces[0].postProcessor.getAverage()
+                                                                : postEQSumProcessor.getAverage();
+    const auto& input = preEQTrace.postProcessor.getAverage();
+
+    for (size_t i = 0; i < differenceData.size(); ++i)
+        differenceData[i] = juce::jlimit(-24.f, 24.f, output[i] - input[i]) - 24.f;
+
+    differencePathProducer.generatePath(differenceData, stitchedFrequencies, layoutVersion, fftBounds, -48.f);
 }
 
-void PathProducer::process(juce::Rectangle<float> fftBounds, double sampleRate)
+// Called by the shared analyzer worker, never on the message thread   ~A
+int ResponseCurveWindow::runAnalysis()
 {
-    juce::AudioBuffer<float> tempIncomingBuffer;
+    auto settings = getAnalyzerSettings(audioProcessor.apvts);
+    int numFrames = 0;
 
-    while (leftChannelFifo->getNumCompleteBuffersAvailable() > 0)
+    if (settings.enabled)
     {
-        if (leftChannelFifo->getAudioBuffer(tempIncomingBuffer))
+        juce::Rectangle<float> fftBounds;
         {
-            auto size = tempIncomingBuffer.getNumSamples();
-
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, 0),
-                monoBuffer.getReadPointer(0, size),
-                monoBuffer.getNumSamples() - size);
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, monoBuffer.getNumSamples() - size),
-                tempIncomingBuffer.getReadPointer(0, 0),
-                size);
-
-            leftChannelFFTDataGenerator.produceFFTDataForRendering(monoBuffer, -48.f);
+            const juce::SpinLock::ScopedLockType sl(analyzerBoundsLock);
+            fftBounds = analyzerBounds;
         }
+        auto sampleRate = audioProcessor.getSampleRate();
+
+        if (!fftBounds.isEmpty() && sampleRate > 0)
+            numFrames += pathProducer.process(fftBounds, spectrogram.getColumnHeight(), sampleRate, settings);
     }
+    else if (analyzerRunning)
+    {
+        pathProducer.reset();
+    }
+    analyzerRunning = settings.enabled;
 
-    // If there are FFT data buffers to pull and we can pull them, generate a path  ~A
-    
-    const auto fftSize = leftChannelFFTDataGenerator.getFFTSize();
-    const auto binWidth = sampleRate / (double)fftSize;
+    return numFrames;
+}
+
+int ResponseCurveWindow::frameTick()
+{
+    updateAnalyzerShowing();
+
+    // Nothing to look at, visibilityChanged() wakes us up again   ~A
+    if (!isShowing())
+        return hiddenIntervalMs;
+
+    const auto now = juce::Time::getMillisecondCounterHiRes();
 
-    while (leftChannelFFTDataGenerator.getNumAvailableFFTDataBlokcs() > 0)
+    // Only picking up what the worker finished, all the FFT work happens there  ~A
+    bool analyzerChanged = false;
+    auto analyzerEnabled = audioProcessor.apvts.getRawParameterValue("Analyzer Enabled")->load() > 0.5f;
+
+    if (analyzerEnabled)
     {
-        std::vector<float> fftData;
-        if (leftChannelFFTDataGenerator.getFFTData(fftData))
-        {
-            pathProducer.generatePath(fftData, fftBounds, fftSize, binWidth, -48.f);
-        }
+        analyzerChanged = pathProducer.pullLatestPaths();
+
+        // One column per analyzer frame, so the spectrogram scrolls with the audio   ~A
+        while (pathProducer.pullSpectrogramColumn(spectrogramColumn))
+            spectrogram.pushColumn(spectrogramColumn);
     }
+    else if (analyzerPathsShown)
+    {
+        pathProducer.clearPaths();
+        analyzerChanged = true;
+    }
+    analyzerPathsShown = analyzerEnabled;
 
-    // While there are paths that can be pulled, pull as many as possible,
-    // we can only display the most recent path ~A
-    while (pathProducer.getNumPathsAvailable())
+    // The processor publishes new coefficients with the block after a change, a new
+    // sample rate included. Parameter changes may also be analyzer settings   ~A
+    auto chainChanged = updateChain();
+    auto settingsChanged = parametersChanged.compareAndSetBool(false, true);
+
+    if (settingsChanged || analyzerChanged)
+        renderAnalyzerLayer();
+
+    if (chainChanged || settingsChanged)
+    {
+        // Signaling a repaint, the curve can reach into the margins around the analysis area  ~A
+        repaint(getRenderArea());
+        lastActivityMs = now;
+    }
+    else if (analyzerChanged)
     {
-        pathProducer.getPath(leftChannelFFTPath);
+        // Only the traces moved   ~A
+        repaint(getAnalysisArea());
+        lastActivityMs = now;
     }
+
+    return now - lastActivityMs < activityHoldMs ? FrameClock::frameIntervalMs : idleIntervalMs;
 }
 
-void ResponseCurveWindow::timerCallback()
+bool ResponseCurveWindow::updateChain()
 {
-    
-    auto fftBounds = getAnalysisArea().toFloat();
-    fftBounds.removeFromLeft(20);
-    auto sampleRate = audioProcessor.getSampleRate();
+    const auto& snapshot = audioProcessor.getCoefficientSnapshot();
+    if (snapshot.version == chainVersion)
+        return false;
 
-    leftPathProducer.process(fftBounds, sampleRate);
-    rightPathProducer.process(fftBounds, sampleRate);
-   
+    chainVersion = snapshot.version;
+    allBypassed = snapshot.allBypassed;
+
+    updateResponseCurve();
+    return true;
+}
+
+void BandResponseCache::setGrid(int numPoints, double sampleRate)
+{
+    if (numPoints == gridPoints && sampleRate == gridSampleRate)
+        return;
+
+    gridPoints = numPoints;
+    gridSampleRate = sampleRate;
 
-    if (parametersChanged.compareAndSetBool(false, true))
+    sinSquaredHalfOmega.resize((size_t)numPoints);
+    totalPower.resize((size_t)numPoints);
+    decibels.resize((size_t)numPoints);
+
+    // Using a helper function to change from pixel width range to frequency range ~A
+    for (int i = 0; i < numPoints; ++i)
     {
-        // Updating the monochain   ~A
-        updateChain();
-        // Signaling a repaint  ~A
-        //repaint();
+        auto freq = juce::mapToLog10(double(i) / numPoints, 20.0, 20000.0);
+        auto s = std::sin(juce::MathConstants<double>::pi * freq / sampleRate);
+        sinSquaredHalfOmega[(size_t)i] = (float)(s * s);
     }
-    // Changed the repaint call from only when parameters changed to consant
-    // due to the need of painting the spectrum    ~A
-    repaint();
+
+    for (auto& power : bandPower)
+        power.resize((size_t)numPoints);
+
+    bandNeedsUpdate.fill(true);
+    totalNeedsUpdate = true;
 }
 
-void ResponseCurveWindow::updateChain()
+void BandResponseCache::setBand(int band, const BandSections& sections)
 {
-    auto chainSettings = getChainSettings(audioProcessor.apvts);
+    if (!bandNeedsUpdate[(size_t)band] && sections == bandSections[(size_t)band])
+        return;
 
-    monoChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed);
-    monoChain.setBypassed<ChainPositions::Band1>(chainSettings.band1Bypassed);
-    monoChain.setBypassed<ChainPositions::Band2>(chainSettings.band2Bypassed);
-    monoChain.setBypassed<ChainPositions::Band3>(chainSettings.band3Bypassed);
-    monoChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed);
-    
+    bandSections[(size_t)band] = sections;
+    bandNeedsUpdate[(size_t)band] = false;
 
-    auto band1Coefficients = makeBand1Filter(chainSettings, audioProcessor.getSampleRate());
-    auto band2Coefficients = makeBand2Filter(chainSettings, audioProcessor.getSampleRate());
-    auto band3Coefficients = makeBand3Filter(chainSettings, audioProcessor.getSampleRate());
-    auto lowCutCoefficients = makeLowCutFilter(chainSettings, audioProcessor.getSampleRate());
-    auto highCutCoefficeints = makeHighCutFilter(chainSettings, audioProcessor.getSampleRate());
+    auto& power = bandPower[(size_t)band];
+    std::fill(power.begin(), power.end(), 1.f);
 
-    updateCoefficients(monoChain.get<ChainPositions::Band1>().coefficients, band1Coefficients);
-    updateCoefficients(monoChain.get<ChainPositions::Band2>().coefficients, band2Coefficients);
-    updateCoefficients(monoChain.get<ChainPositions::Band3>().coefficients, band3Coefficients);
-    updateCutFilter(monoChain.get<ChainPositions::LowCut>(), lowCutCoefficients, chainSettings.lowCutSlope);
-    updateCutFilter(monoChain.get<ChainPositions::HighCut>(), highCutCoefficeints, chainSettings.highCutSlope);
+    for (int i = 0; i < sections.numSections; ++i)
+        multiplyBiquadPower(power.data(), sinSquaredHalfOmega.data(), gridPoints, sections.coefficients[(size_t)i]);
 
-    allBypassed = chainSettings.allBypassed;
+    totalNeedsUpdate = true;
 }
 
-void ResponseCurveWindow::paint(juce::Graphics& g)
+const std::vector<float>& BandResponseCache::getDecibels()
 {
-    using namespace juce;
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll(Colour(0u, 0u, 0u));
-   
-    g.drawImage(responseBackground, getLocalBounds().toFloat());
+    if (totalNeedsUpdate)
+    {
+        std::fill(totalPower.begin(), totalPower.end(), 1.f);
+        for (int band = 0; band < numBands; ++band)
+            if (bandSections[(size_t)band].numSections > 0)
+                juce::FloatVectorOperations::multiply(totalPower.data(), bandPower[(size_t)band].data(), gridPoints);
 
-    auto graphicResponseArea = getAnalysisArea();
+        // Same -100 dB floor as Decibels::gainToDecibels   ~A
+        for (int i = 0; i < gridPoints; ++i)
+            decibels[(size_t)i] = 10.f * std::log10(juce::jmax(totalPower[(size_t)i], 1.0e-10f));
 
-    int w = graphicResponseArea.getWidth();
+        totalNeedsUpdate = false;
+    }
 
-    auto& lowcut = monoChain.get<ChainPositions::LowCut>();
-    auto& band1 = monoChain.get<ChainPositions::Band1>();
-    auto& band2 = monoChain.get<ChainPositions::Band2>();
-    auto& band3 = monoChain.get<ChainPositions::Band3>();
-    auto& highcut = monoChain.get<ChainPositions::HighCut>();
+    return decibels;
+}
 
-    double sampleRate = audioProcessor.getSampleRate();
+void BandResponseCache::multiplyBiquadPower(float* power, const float* p, int numPoints, const std::array<double, 5>& section)
+{
+    // The sums are done once per section in double, which is where precision matters  ~A
+    auto getTerms = [](double c0, double c1, double c2)
+    {
+        return std::array<float, 3>{ (float)((c0 + c1 + c2) * (c0 + c1 + c2)),
+                                     (float)(-4.0 * (c0 * c1 + 4.0 * c0 * c2 + c1 * c2)),
+                                     (float)(16.0 * c0 * c2) };
+    };
 
-    // Creating a vector of doubles to be iterated thru that will be 
-    // resized to the width of the display in pixels and contain magnitudes  ~A
-    std::vector<double> magnitudes;
-    magnitudes.resize(w);
+    const auto b = getTerms(section[0], section[1], section[2]);
+    const auto a = getTerms(1.0, section[3], section[4]);
 
-    for (int i = 0; i < w; i++)
+    for (int i = 0; i < numPoints; ++i)
     {
-        double magnitude = 1.f;
-        // Using a helper function to change from pixel width range to frequency range ~A
-        auto freq = mapToLog10(double(i) / w, 20.0, 20000.0);
+        auto x = p[i];
+        auto numerator = b[0] + x * (b[1] + x * b[2]);
+        auto denominator = a[0] + x * (a[1] + x * a[2]);
+        power[i] *= numerator / denominator;
+    }
+}
 
-        // Multiplying magnitude by every link of the chain IF it's not bypassed    ~A
+// Only runs when the chain or the size changed, the repaints for the analyzer
+// just stroke the path built here. Of the chain only the bands that changed get
+// evaluated again   ~A
+void ResponseCurveWindow::updateResponseCurve()
+{
+    using namespace juce;
 
-        // 3 bands  ~A
-        if (!monoChain.isBypassed<ChainPositions::Band1>())
-            magnitude *= band1.coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!monoChain.isBypassed<ChainPositions::Band2>())
-            magnitude *= band2.coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        if (!monoChain.isBypassed<ChainPositions::Band3>())
-            magnitude *= band3.coefficients->getMagnitudeForFrequency(freq, sampleRate);
+    auto graphicResponseArea = getAnalysisArea();
 
-        // 4 slope options of low and high cut ~A
-        if (!monoChain.isBypassed<ChainPositions::LowCut>())
-        {
-            if (!lowcut.isBypassed<0>())
-                magnitude *= lowcut.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!lowcut.isBypassed<1>())
-                magnitude *= lowcut.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!lowcut.isBypassed<2>())
-                magnitude *= lowcut.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!lowcut.isBypassed<3>())
-                magnitude *= lowcut.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        }
-       
-        if (!monoChain.isBypassed<ChainPositions::HighCut>())
-        {
-            if (!highcut.isBypassed<0>())
-                magnitude *= highcut.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!highcut.isBypassed<1>())
-                magnitude *= highcut.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!highcut.isBypassed<2>())
-                magnitude *= highcut.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (!highcut.isBypassed<3>())
-                magnitude *= highcut.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        }
-        
+    // Evaluated for every physical pixel column of the curve layer   ~A
+    int w = roundToInt((float)graphicResponseArea.getWidth() * layerScale);
+    // The newest the processor published, already picked up by updateChain()   ~A
+    const auto& snapshot = audioProcessor.getCoefficientSnapshot();
+    double sampleRate = snapshot.sampleRate;
 
-        magnitudes[i] = Decibels::gainToDecibels(magnitude);
+    if (w <= 0 || sampleRate <= 0)
+    {
+        responseCurve.clear();
+        renderCurveLayer();
+        return;
     }
 
+    responseCache.setGrid(w, sampleRate);
+
+    for (int band = 0; band < BandResponseCache::numBands; ++band)
+        responseCache.setBand(band, snapshot.bands[(size_t)band]);
+
+    const auto& magnitudes = responseCache.getDecibels();
    
-    Path responseCurve;
-    const double outputMin = graphicResponseArea.getBottom();
-    const double outputMax = graphicResponseArea.getY();
+    const double outputMin = graphicResponseArea.getBottom() * layerScale;
+    const double outputMax = graphicResponseArea.getY() * layerScale;
 
     // Declaring a helper lambda    ~A
     auto map = [outputMin, outputMax](double input)
@@ -369,72 +1521,151 @@ void ResponseCurveWindow::paint(juce::Graphics& g)
         return jmap(input, -24.0, 24.0, outputMin, outputMax);
     };
 
-    // Starting a response subpath on the leftmost pixel given the first magnitude value from the vector    ~A
-    responseCurve.startNewSubPath(graphicResponseArea.getX(), map(magnitudes.front()));
+    // One y per pixel, the curve breaks off wherever it leaves the window's range   ~A
+    responseCurve.resize(magnitudes.size());
+    for (size_t i = 0; i < magnitudes.size(); i++)
+    {
+        if (magnitudes[i] > -25 && magnitudes[i] < 25)
+            responseCurve[i] = (float)map(magnitudes[i]);
+        else
+            responseCurve[i] = std::numeric_limits<float>::quiet_NaN();
+    }
+
+    renderCurveLayer();
+}
+
+// The window is composited from three layers: the static one with the grid,
+// labels and outline, the analyzer traces and the response curve on top. The
+// two images are only blitted where the clip says something changed   ~A
+void ResponseCurveWindow::paint(juce::Graphics& g)
+{
+    using namespace juce;
+    EQ_LITE_PROFILE_UI(ResponseCurvePaint);
+    // (Our component is opaque, so we must completely fill the background with a solid colour)
 
-    // Continuing the response curve by drawing a new line with different bearing from pixel to pixel   ~A
-    for (size_t i = 1; i < magnitudes.size(); i++)
+    // The layers follow the display's scale so they stay as sharp as drawing
+    // straight into the window would be. Moving to another display rebuilds them once   ~A
+    auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (!approximatelyEqual(scale, layerScale))
     {
-        // Trying some walkaround to fix the response cureve's drawing area problem     ~A
-        
-        // Declaring bools for clarity of the subsequent if-chain   ~A
-         bool isCurrMagWithinBounds{ false };
-         bool isPrevMagWithinBounds{ false };
-
-         if (magnitudes.at(i) > -25 && magnitudes.at(i) < 25)
-             isCurrMagWithinBounds = true;
-         if (magnitudes.at(i - 1) > -25 && magnitudes.at(i - 1) < 25)
-             isPrevMagWithinBounds = true;
-
-         // Walkaround logic to keep the response curve vertically within shrunken window bounds    ~A
-
-         if (isCurrMagWithinBounds && isPrevMagWithinBounds)
-         {
-             responseCurve.lineTo(graphicResponseArea.getX() + i, map(magnitudes.at(i)));
-         }
-         else if (isCurrMagWithinBounds && !isPrevMagWithinBounds)
-         {
-             responseCurve.startNewSubPath(graphicResponseArea.getX() + i, map(magnitudes.at(i)));
-         }
+        layerScale = scale;
+        createLayers();
+    }
 
-        
-        
+    // Scaled back down to the logical size, which lands every layer pixel on a
+    // physical one. The graphics context only touches what's inside the clip   ~A
+    auto clip = g.getClipBounds();
+    const auto toLogical = AffineTransform::scale(1.f / layerScale);
+    auto blit = [&g, &toLogical](const Image& layer)
+    {
+        g.drawImageTransformed(layer, toLogical);
+    };
+
+    blit(responseBackground);
+
+    if (analyzerPathsShown && clip.intersects(getAnalysisArea()))
+        blit(analyzerLayer);
+
+    // Built in updateResponseCurve(), painting just blits it   ~A
+    blit(curveLayer);
+}
+
+void ResponseCurveWindow::renderAnalyzerLayer()
+{
+    using namespace juce;
+
+    if (!analyzerLayer.isValid())
+        return;
+
+    analyzerLayer.clear(analyzerLayer.getBounds());
+
+    if (!analyzerPathsShown)
+        return;
+
+    Image::BitmapData pixels(analyzerLayer, Image::BitmapData::readWrite);
+
+    // Drawing the spectrum analyser. In Left/Right and Mid/Side mode the first
+    // trace is left or mid, the second one right or side. The worker made the
+    // paths in layer pixels, see createLayers()    ~A
+    auto graphicResponseArea = getAnalysisArea();
+    auto left = roundToInt((float)graphicResponseArea.getX() * layerScale);
+    auto top = (float)graphicResponseArea.getY() * layerScale;
+    auto thin = layerScale, thick = 1.5f * layerScale;
+    auto numTraces = getAnalyzerNumTraces((int)audioProcessor.apvts.getRawParameterValue("Analyzer Mode")->load());
+    auto showPeaks = audioProcessor.apvts.getRawParameterValue("Analyzer Peak Hold")->load() > 0.5f;
+    const Colour traceColours[] = { Colours::lightpink, Colours::lightyellow };
+
+    // The input before the EQ behind the output, and how far apart the two are   ~A
+    auto showPreEQ = audioProcessor.apvts.getRawParameterValue("Analyzer Pre EQ")->load() > 0.5f;
+    if (showPreEQ)
+        PolylineRenderer::draw(pixels, pathProducer.getPreEQPath(), left, top, Colours::lightblue.withAlpha(0.6f), thin);
+
+    for (int trace = 0; trace < numTraces; ++trace)
+    {
+        PolylineRenderer::draw(pixels, pathProducer.getPath(trace), left, top, traceColours[trace], thin);
+
+        // Peak hold traces, dimmer than the live ones   ~A
+        if (showPeaks)
+            PolylineRenderer::draw(pixels, pathProducer.getPeakPath(trace), left, top, traceColours[trace].withAlpha(0.5f), thin);
     }
 
-    // Drawing the spectrum analyser    ~A
-    auto leftChannelFFTPath = leftPathProducer.getPath();
-    leftChannelFFTPath.applyTransform(AffineTransform().translation(graphicResponseArea.getX(), graphicResponseArea.getY()));
-    
-    g.setColour(Colours::lightpink);
-    g.strokePath(leftChannelFFTPath, PathStrokeType(1));
+    if (showPreEQ)
+        PolylineRenderer::draw(pixels, pathProducer.getDifferencePath(), left, top, Colours::orange, thick);
+}
 
-    auto rightChannelFFTPath = rightPathProducer.getPath();
-    rightChannelFFTPath.applyTransform(AffineTransform().translation(graphicResponseArea.getX(), graphicResponseArea.getY()));
-    
-    g.setColour(Colours::lightyellow);
-    g.strokePath(rightChannelFFTPath, PathStrokeType(1));
+void ResponseCurveWindow::renderCurveLayer()
+{
+    using namespace juce;
 
-    // Drawing an outline and the path   ~A
-    g.setColour(Colours::burlywood);
-    g.drawRoundedRectangle(getRenderArea().toFloat(), 10.f, 2.f);
-    
-    
-    
-    auto color = (allBypassed) ? Colours::dimgrey : Colours::azure;
-    
+    if (!curveLayer.isValid())
+        return;
 
-    g.setColour(color);
-    g.strokePath(responseCurve, PathStrokeType(2.f));
+    curveLayer.clear(curveLayer.getBounds());
+    Image::BitmapData pixels(curveLayer, Image::BitmapData::readWrite);
 
-    
+    auto color = (allBypassed) ? Colours::dimgrey : Colours::azure;
+
+    // One column per layer pixel, see updateResponseCurve()   ~A
+    PolylineRenderer::draw(pixels, responseCurve, roundToInt((float)getAnalysisArea().getX() * layerScale), 0.f,
+                           color, 2.f * layerScale);
 }
 
 void ResponseCurveWindow::resized()
+{
+    createLayers();
+}
+
+// Every layer has layerScale physical pixels per logical one. The static layer is
+// drawn in logical coordinates through a scale transform. The response curve and
+// the analyzer paths are made with one point per layer pixel column, so the
+// PolylineRenderer draws them at full resolution   ~A
+void ResponseCurveWindow::createLayers()
 {
     using namespace juce;
-    responseBackground = Image(Image::PixelFormat::RGB, getWidth(), getHeight(), true);
+
+    const auto layerWidth = jmax(1, roundToInt((float)getWidth() * layerScale));
+    const auto layerHeight = jmax(1, roundToInt((float)getHeight() * layerScale));
+
+    // The worker makes the analyzer paths for the analyzer layer, so in its pixels   ~A
+    {
+        auto fftBounds = getAnalysisArea().toFloat();
+        fftBounds.removeFromLeft(20);
+
+        const SpinLock::ScopedLockType sl(analyzerBoundsLock);
+        analyzerBounds = fftBounds * layerScale;
+    }
+
+    curveLayer = Image(Image::PixelFormat::ARGB, layerWidth, layerHeight, true);
+    updateResponseCurve();
+
+    // The old paths were made for the old size, the worker sends new ones soon   ~A
+    analyzerLayer = Image(Image::PixelFormat::ARGB, layerWidth, layerHeight, true);
+
+    // The static layer, only redrawn here   ~A
+    responseBackground = Image(Image::PixelFormat::RGB, layerWidth, layerHeight, true);
     
     Graphics g(responseBackground);
+    g.addTransform(AffineTransform::scale(layerScale));
 
     // Creating an array holding the frequencies that will be marked on the response window grid    ~A
     Array<float> frequencies
@@ -547,6 +1778,9 @@ void ResponseCurveWindow::resized()
         g.drawFittedText(str, r, juce::Justification::right, 1);
     }
 
+    // Drawing an outline   ~A
+    g.setColour(Colours::burlywood);
+    g.drawRoundedRectangle(getRenderArea().toFloat(), 10.f, 2.f);
 
 }
 
@@ -610,7 +1844,9 @@ EQ_LiteAudioProcessorEditor::EQ_LiteAudioProcessorEditor(EQ_LiteAudioProcessor&
     band2BypassButtonAttachment(audioProcessor.apvts, "Band2 Bypassed", band2BypassButton),
     band3BypassButtonAttachment(audioProcessor.apvts, "Band3 Bypassed", band3BypassButton),
     allBypassButtonAttachment(audioProcessor.apvts, "All Bypassed", allBypassButton),
-    analyzerEnabledButtonAttachment(audioProcessor.apvts, "Analyzer Enabled", analyzerEnabledButton)
+    analyzerEnabledButtonAttachment(audioProcessor.apvts, "Analyzer Enabled", analyzerEnabledButton),
+    morphEnabledButtonAttachment(audioProcessor.apvts, "Morph Enabled", morphEnabledButton),
+    morphSliderAttachment(audioProcessor.apvts, "Morph Position", morphSlider)
 
 
 
@@ -654,17 +1890,64 @@ EQ_LiteAudioProcessorEditor::EQ_LiteAudioProcessorEditor(EQ_LiteAudioProcessor&
         addAndMakeVisible(component);
     }
 
-    lowcutBypassButton.setLookAndFeel(&lnf);
-    band1BypassButton.setLookAndFeel(&lnf);
-    band2BypassButton.setLookAndFeel(&lnf);
-    band3BypassButton.setLookAndFeel(&lnf);
-    highcutBypassButton.setLookAndFeel(&lnf);
-    allBypassButton.setLookAndFeel(&lnf);
+    addAndMakeVisible(responseCurveWindow.getSpectrogram());
+
+    // The switch itself happens in the processor, crossfaded, these only ask for it   ~A
+    presetBox.setTextWhenNothingSelected("Presets");
+    presetBox.setTextWhenNoChoicesAvailable("No presets saved");
+    presetBox.onChange = [this]
+    {
+        if (presetBox.getSelectedItemIndex() >= 0)
+            audioProcessor.loadPreset(presetBox.getSelectedItemIndex());
+    };
+    refreshPresetList();
+    addAndMakeVisible(presetBox);
+
+    savePresetButton.onClick = [this] { savePresetAs(); };
+    addAndMakeVisible(savePresetButton);
+
+    for (int slot = 0; slot < (int)comparisonButtons.size(); ++slot)
+    {
+        auto& button = comparisonButtons[(size_t)slot];
+        button.setButtonText(juce::String::charToString((juce::juce_wchar)('A' + slot)));
+        button.setRadioGroupId(1);
+        button.setClickingTogglesState(true);
+        button.setToggleState(slot == audioProcessor.getComparisonSlot(), juce::dontSendNotification);
+        button.onClick = [this, slot]
+        {
+            if (comparisonButtons[(size_t)slot].getToggleState())
+                audioProcessor.selectComparisonSlot(slot);
+        };
+        addAndMakeVisible(button);
+    }
+
+    addAndMakeVisible(morphEnabledButton);
+    addAndMakeVisible(morphSlider);
+
+    for (int end = 0; end < (int)morphEndButtons.size(); ++end)
+    {
+        morphEndButtons[(size_t)end].onClick = [this, end]
+        {
+            audioProcessor.captureMorphEnd(end);
+            updateMorphEndButtons();
+        };
+        addAndMakeVisible(morphEndButtons[(size_t)end]);
+    }
+    updateMorphEndButtons();
+
+    backgroundTexture = juce::ImageCache::getFromMemory(BinaryData::basictexture2_png, BinaryData::basictexture2_pngSize);
+
+    lowcutBypassButton.setLookAndFeel(lnf.get());
+    band1BypassButton.setLookAndFeel(lnf.get());
+    band2BypassButton.setLookAndFeel(lnf.get());
+    band3BypassButton.setLookAndFeel(lnf.get());
+    highcutBypassButton.setLookAndFeel(lnf.get());
+    allBypassButton.setLookAndFeel(lnf.get());
     
 
 
-    // Size of the whole plugin window     ~A
-    setSize (800, 625);
+    // Size of the whole plugin window, the preset bar and the spectrogram strip sit below the knobs     ~A
+    setSize (800, 625 + presetBarHeight + spectrogramHeight);
     
 }
 
@@ -679,10 +1962,53 @@ EQ_LiteAudioProcessorEditor::~EQ_LiteAudioProcessorEditor()
 
 }
 
+// Showing which ends hold something, clicking one again recaptures it   ~A
+void EQ_LiteAudioProcessorEditor::updateMorphEndButtons()
+{
+    for (int end = 0; end < (int)morphEndButtons.size(); ++end)
+    {
+        auto name = juce::String(end == 0 ? "From" : "To");
+        morphEndButtons[(size_t)end].setButtonText(audioProcessor.hasMorphEnd(end) ? name + " *" : "Set " + name);
+    }
+}
+
+void EQ_LiteAudioProcessorEditor::refreshPresetList()
+{
+    auto& bank = audioProcessor.getPresetBank();
+
+    presetBox.clear(juce::dontSendNotification);
+    for (int index = 0; index < bank.getNumPresets(); ++index)
+        presetBox.addItem(bank.getName(index), index + 1);
+}
+
+void EQ_LiteAudioProcessorEditor::savePresetAs()
+{
+    auto* window = new juce::AlertWindow("Save preset", "Name for the current settings:", juce::AlertWindow::NoIcon, this);
+    window->addTextEditor("name", "Preset " + juce::String(audioProcessor.getPresetBank().getNumPresets() + 1));
+    window->addButton("Save", 1, juce::KeyPress(juce::KeyPress::returnKey));
+    window->addButton("Cancel", 0, juce::KeyPress(juce::KeyPress::escapeKey));
+
+    juce::Component::SafePointer<EQ_LiteAudioProcessorEditor> editor(this);
+    window->enterModalState(true, juce::ModalCallbackFunction::create([editor, window](int result)
+    {
+        auto name = window->getTextEditorContents("name").trim();
+        if (editor == nullptr || result == 0 || name.isEmpty())
+            return;
+
+        if (!editor->audioProcessor.savePreset(name))
+            juce::AlertWindow::showMessageBoxAsync(juce::AlertWindow::WarningIcon, "Save preset",
+                                                   "Couldn't write " + PresetBank::getDefaultFile().getFullPathName());
+
+        editor->refreshPresetList();
+        editor->presetBox.setSelectedItemIndex(editor->presetBox.getNumItems() - 1, juce::dontSendNotification);
+    }), true);
+}
+
 //==============================================================================
 void EQ_LiteAudioProcessorEditor::paint (juce::Graphics& g)
 {
     using namespace juce;
+    EQ_LITE_PROFILE_UI(EditorBackground);
     //g.fillAll(Colours::black);
     
     
@@ -701,9 +2027,12 @@ void EQ_LiteAudioProcessorEditor::paint (juce::Graphics& g)
     //juce::Rectangle<float> lcOutline(200.f, 200.f, 200.f, 200.f);
     //g.drawRoundedRectangle(lcOutline, 50.f, 5.f);
    
-    Image backgroundTexture = ImageCache::getFromMemory(BinaryData::basictexture2_png, BinaryData::basictexture2_pngSize);
+    // Decoded once in the constructor   ~A
     g.setOpacity(1.0f);
     g.drawImageAt(backgroundTexture, 0, 0, false);
+
+    g.setColour(juce::Colours::black);
+    g.fillRect(getLocalBounds().withTrimmedBottom(spectrogramHeight).removeFromBottom(presetBarHeight));
     
 
 
@@ -717,6 +2046,23 @@ void EQ_LiteAudioProcessorEditor::resized()
 
     // Setting positions of my custom components    ~A
     auto bounds = getLocalBounds();
+    responseCurveWindow.getSpectrogram().setBounds(bounds.removeFromBottom(spectrogramHeight));
+
+    auto presetBar = bounds.removeFromBottom(presetBarHeight).reduced(4, 3);
+    for (auto it = comparisonButtons.rbegin(); it != comparisonButtons.rend(); ++it)
+        it->setBounds(presetBar.removeFromRight(presetBarHeight).reduced(1, 0));
+    presetBar.removeFromRight(8);
+    savePresetButton.setBounds(presetBar.removeFromRight(60));
+    presetBar.removeFromRight(4);
+
+    morphEnabledButton.setBounds(presetBar.removeFromLeft(70));
+    morphEndButtons[0].setBounds(presetBar.removeFromLeft(60));
+    morphSlider.setBounds(presetBar.removeFromLeft(180).reduced(4, 0));
+    morphEndButtons[1].setBounds(presetBar.removeFromLeft(60));
+    presetBar.removeFromLeft(8);
+
+    presetBox.setBounds(presetBar);
+
     auto graphicResponseArea = bounds.removeFromTop(bounds.getHeight() * 0.3);  // Reserving area for the response window   ~A
     responseCurveWindow.setBounds(graphicResponseArea);
     
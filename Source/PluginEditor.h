@@ -21,85 +21,396 @@ enum FFTOrder
     order8192 = 13
 };
 
+// Adding data structure holding all the analyzer settings, the worker reads them once per pass   ~A
+struct AnalyzerSettings
+{
+    bool enabled{ true };
+    int overlap{ AnalyzerOverlap::Overlap_75 };
+    FFTOrder order{ FFTOrder::order2048 };
+    int smoothingBandsPerOctave{ 0 };
+    float averagingSeconds{ 0.f };
+    bool peakHold{ false };
+    int mode{ AnalyzerMode::Mode_LeftRight };
+    bool showPreEQ{ false };
+};
+
+AnalyzerSettings getAnalyzerSettings(juce::AudioProcessorValueTreeState& apvts);
+
+// Channels of the analyzer's own decimated histories. The input before the EQ
+// is only analyzed as the sum of both channels   ~A
+enum AnalyzedChannel
+{
+    AnalyzedLeft,
+    AnalyzedRight,
+    AnalyzedPreEQ,
+    NumAnalyzedChannels
+};
+
+// Where each spectrum sits in an FFT data block   ~A
+enum SpectrumSlot
+{
+    FirstTraceSpectrum,
+    SecondTraceSpectrum,
+    PreEQSpectrum,
+    PostEQSumSpectrum,
+    NumSpectrumSlots
+};
+
+// Stereo FFT data generator. Left goes into the real and right into the imaginary
+// part of one complex FFT, and the two spectra get pulled apart afterwards using
+// the symmetry of real signals' spectra:
+//     L[k] = (Z[k] + conj(Z[N - k])) / 2,   R[k] = (Z[k] - conj(Z[N - k])) / 2j
+// One transform for both channels instead of two. Mid/Side and the sum are just
+// sums of L[k] and R[k], so they come for free from the same transform   ~A
+//
+// The pre EQ sum is a single real signal, so it goes through a complex FFT of half
+// the size with the even samples in the real and the odd ones in the imaginary
+// part, split the same way and recombined with one twiddle per bin. Showing the
+// input on top of the output costs half an FFT more, not a whole one   ~A
 template<typename BlockType>
 struct FFTDataGenerator
 {
-    void produceFFTDataForRendering(const juce::AudioBuffer<float>& audioData, const float negativeInfinity)
+    // Plans, windows and twiddles for every order are built up front, so switching
+    // the resolution later is just picking another one - nothing gets allocated  ~A
+    FFTDataGenerator()
+    {
+        for (int i = 0; i < numOrders; ++i)
+        {
+            auto newOrder = FFTOrder::order2048 + i;
+            auto fftSize = 1 << newOrder;
+            forwardFFTs[(size_t)i] = std::make_unique<juce::dsp::FFT>(newOrder);
+            halfSizeFFTs[(size_t)i] = std::make_unique<juce::dsp::FFT>(newOrder - 1);
+            windows[(size_t)i] = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize,
+                                                                                       juce::dsp::WindowingFunction<float>::blackmanHarris);
+
+            auto& twiddle = twiddles[(size_t)i];
+            twiddle.resize((size_t)fftSize / 2 + 1);
+            for (int k = 0; k <= fftSize / 2; ++k)
+                twiddle[(size_t)k] = std::polar(1.f, -juce::MathConstants<float>::twoPi * (float)k / (float)fftSize);
+        }
+
+        fftData.assign(slotSize * NumSpectrumSlots, 0);
+        fftDataFifo.prepare(fftData.size());
+
+        for (auto& channel : samples)
+            channel.resize(maxFFTSize);
+        timeData.resize(maxFFTSize);
+        spectrum.resize(maxFFTSize);
+    }
+
+    // Reading the fftSize samples that end at endPosition straight out of the
+    // analyzer history. Returns false if they were overwritten already. The result
+    // is the raw magnitude of every bin, each spectrum in its own SpectrumSlot.
+    // Normalizing and the decibel conversion happen later in one go, see
+    // SpectrumPostProcessor   ~A
+    bool produceFFTDataForRendering(const SampleRingBuffer& history,
+                                    juce::int64 endPosition,
+                                    int mode,
+                                    bool withPreEQ)
     {
         const auto fftSize = getFFTSize();
+        const auto numChannels = withPreEQ ? NumAnalyzedChannels : AnalyzedPreEQ;
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* channel = samples[(size_t)ch].data();
+            if (!history.read(ch, channel, fftSize, endPosition))
+                return false;
 
-        fftData.assign(fftData.size(), 0);
-        auto* readIndex = audioData.getReadPointer(0);
-        std::copy(readIndex, readIndex + fftSize, fftData.begin());
+            // Applying a windowing function to our data   ~A
+            windows[getOrderIndex()]->multiplyWithWindowingTable(channel, fftSize);
+        }
+
+        const auto* left = samples[AnalyzedLeft].data();
+        const auto* right = samples[AnalyzedRight].data();
 
-        // Applying a windowing function to our data   ~A
-        window->multiplyWithWindowingTable(fftData.data(), fftSize);
+        for (int n = 0; n < fftSize; ++n)
+            timeData[(size_t)n] = { left[n], right[n] };
 
         // Rendering FFT data   ~A
-        forwardFFT->performFrequencyOnlyForwardTransform(fftData.data());
+        forwardFFTs[getOrderIndex()]->perform(timeData.data(), spectrum.data(), false);
 
-        int numBins = (int)fftSize / 2;
+        // Only bins 0 to N/2 are shown   ~A
+        const auto mask = fftSize - 1;
+        auto* first = getSlot(FirstTraceSpectrum);
+        auto* second = getSlot(SecondTraceSpectrum);
+        auto* postSum = getSlot(PostEQSumSpectrum);
 
-        // Normalizing fft values   ~A
-        for (int i = 0; i < numBins; ++i)
-        {
-            fftData[i] /= (float)numBins;
-        }
-        // Converting them to decibels  ~A
-        for (int i = 0; i < numBins; ++i)
+        for (int k = 0; k <= fftSize / 2; ++k)
         {
-            fftData[i] = juce::Decibels::gainToDecibels(fftData[i], negativeInfinity);
+            auto z = spectrum[(size_t)k];
+            auto mirrored = std::conj(spectrum[(size_t)((fftSize - k) & mask)]);
+
+            auto leftBin = (z + mirrored) * 0.5f;
+            auto difference = z - mirrored;
+            auto rightBin = juce::dsp::Complex<float>(difference.imag() * 0.5f, -difference.real() * 0.5f);
+            auto sumMagnitude = std::abs(leftBin + rightBin);
+
+            switch (mode)
+            {
+            case AnalyzerMode::Mode_MidSide:
+                first[k] = sumMagnitude * 0.5f;
+                second[k] = std::abs(leftBin - rightBin) * 0.5f;
+                break;
+            case AnalyzerMode::Mode_Sum:
+                first[k] = sumMagnitude;
+                break;
+            default:
+                first[k] = std::abs(leftBin);
+                second[k] = std::abs(rightBin);
+                break;
+            }
+
+            postSum[k] = sumMagnitude;
         }
+
+        if (withPreEQ)
+            transformPreEQ(fftSize);
+
         fftDataFifo.push(fftData);
+        return true;
     }
 
+    // Must be called from the thread that produces and pulls the FFT data   ~A
     void changeOrder(FFTOrder newOrder)
     {
         order = newOrder;
-        auto fftSize = getFFTSize();
 
-        forwardFFT = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize, juce::dsp::WindowingFunction<float>::blackmanHarris);
-
-        fftData.clear();
-        fftData.resize(fftSize * 2, 0);
-
-        fftDataFifo.prepare(fftData.size());
+        // Frames still queued were made with the old order   ~A
+        while (fftDataFifo.pull(fftData)) {}
     }
     //===================================================================
+    static constexpr int numOrders = FFTOrder::order8192 - FFTOrder::order2048 + 1;
+    static constexpr int maxFFTSize = 1 << FFTOrder::order8192;
+
+    // Bins 0 to N/2 of the largest order   ~A
+    static constexpr int slotSize = maxFFTSize / 2 + 1;
+
+    FFTOrder getOrder() const { return order; }
     int getFFTSize() const { return 1 << order; }
-    int getNumAvailableFFTDataBlokcs() { return fftDataFifo.pull(fftData); }
+    int getNumAvailableFFTDataBlokcs() const { return fftDataFifo.getNumAvailableForReading(); }
     //===================================================================
+    // 'fftData' should already be sized like the fifo slots, it gets swapped in  ~A
     bool getFFTData(BlockType& fftData) { return fftDataFifo.pull(fftData); }
 private:
-    FFTOrder order;
+    FFTOrder order = FFTOrder::order2048;
     BlockType fftData;
-    std::unique_ptr<juce::dsp::FFT> forwardFFT;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
+    std::array<std::vector<float>, NumAnalyzedChannels> samples;
+    std::vector<juce::dsp::Complex<float>> timeData, spectrum;
+    std::array<std::unique_ptr<juce::dsp::FFT>, numOrders> forwardFFTs, halfSizeFFTs;
+    std::array<std::unique_ptr<juce::dsp::WindowingFunction<float>>, numOrders> windows;
+    std::array<std::vector<juce::dsp::Complex<float>>, numOrders> twiddles;
+
+    size_t getOrderIndex() const { return (size_t)(order - FFTOrder::order2048); }
+    float* getSlot(int slot) { return fftData.data() + slot * slotSize; }
+
+    // Real FFT of the pre EQ sum through the half size complex FFT   ~A
+    void transformPreEQ(int fftSize)
+    {
+        const auto halfSize = fftSize / 2;
+        const auto* pre = samples[AnalyzedPreEQ].data();
+
+        for (int n = 0; n < halfSize; ++n)
+            timeData[(size_t)n] = { pre[2 * n], pre[2 * n + 1] };
+
+        halfSizeFFTs[getOrderIndex()]->perform(timeData.data(), spectrum.data(), false);
+
+        const auto mask = halfSize - 1;
+        const auto& twiddle = twiddles[getOrderIndex()];
+        auto* preMagnitudes = getSlot(PreEQSpectrum);
+
+        for (int k = 0; k <= halfSize; ++k)
+        {
+            auto z = spectrum[(size_t)(k & mask)];
+            auto mirrored = std::conj(spectrum[(size_t)((halfSize - k) & mask)]);
+
+            auto even = (z + mirrored) * 0.5f;
+            auto difference = z - mirrored;
+            auto odd = juce::dsp::Complex<float>(difference.imag() * 0.5f, -difference.real() * 0.5f);
+
+            preMagnitudes[k] = std::abs(even + twiddle[(size_t)k] * odd);
+        }
+    }
+
+    // Produced and pulled in the same analyzer pass, so a few slots are plenty  ~A
+    Fifo<BlockType, 4> fftDataFifo;
+
+};
+
+// Analyzer ballistics. Every fresh spectrum goes through one loop over the bins
+// doing the normalization, fractional octave smoothing, a fast log for the
+// decibels, exponential averaging and peak hold with decay. The smoothing reads
+// a running sum of the bin powers, so each bin costs the same no matter how
+// wide its band is. The loop body has no data dependent branches and only
+// touches contiguous arrays, so the compiler can vectorize it   ~A
+struct SpectrumPostProcessor
+{
+    SpectrumPostProcessor(int maxNumBins);
+
+    // Rebuilding the smoothing bands, only needed when the bin layout or the
+    // smoothing setting changes   ~A
+    void prepare(const std::vector<float>& frequencies, int bandsPerOctave);
+
+    void process(const std::vector<float>& magnitudes,
+                 float normalizationDB,
+                 float averagingSeconds,
+                 float negativeInfinity);
+
+    void reset(float negativeInfinity);
+
+    int getBandsPerOctave() const { return smoothingBandsPerOctave; }
+    const std::vector<float>& getAverage() const { return average; }
+    const std::vector<float>& getPeak() const { return peak; }
+
+    static constexpr float peakDecayDBPerSecond = 12.f;
+private:
+    int smoothingBandsPerOctave = 0;
+
+    std::vector<double> runningPowerSum;
+    std::vector<int> bandStart, bandEnd;
+    std::vector<float> inverseBandSize;
+
+    std::vector<float> average, peak;
+    double lastProcessTime = 0;
+};
+
+// Which analyzer bins land on which pixel along a 20 Hz - 20 kHz log axis. Bins
+// sharing a pixel are reduced to their maximum, pixels narrower than a bin get
+// interpolated between the two bins around them. Only changes with the layout or
+// the number of pixels, so it's cached   ~A
+struct PixelBinMap
+{
+    bool isUpToDate(int numPixels, int layoutVersion) const
+    {
+        return numPixels == mappedPixels && layoutVersion == mappedLayoutVersion;
+    }
+
+    void update(const std::vector<float>& frequencies, int numPixels, int layoutVersion)
+    {
+        mappedPixels = numPixels;
+        mappedLayoutVersion = layoutVersion;
+        pixels.assign((size_t)numPixels, {});
+
+        const auto numBins = (int)frequencies.size();
+
+        // The frequencies go up, so the first bin seen on a pixel starts its range   ~A
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            auto pixel = (int)std::floor(juce::mapFromLog10(frequencies[(size_t)bin], 20.f, 20000.f) * numPixels);
+            if (pixel < 0 || pixel >= numPixels)
+                continue;
+
+            auto& bins = pixels[(size_t)pixel];
+            if (bins.end < 0)
+                bins.start = bin;
+            bins.end = bin + 1;
+        }
+
+        for (int pixel = 0; pixel < numPixels; ++pixel)
+        {
+            auto& bins = pixels[(size_t)pixel];
+            if (bins.end > bins.start)
+                continue;
+
+            auto pixelFreq = juce::mapToLog10(((float)pixel + 0.5f) / (float)numPixels, 20.f, 20000.f);
+            auto above = std::upper_bound(frequencies.begin(), frequencies.end(), pixelFreq);
+
+            if (above == frequencies.begin() || above == frequencies.end())
+                continue;
+
+            auto upperBin = (int)(above - frequencies.begin());
+            auto lowerBin = upperBin - 1;
+            auto lowerFreq = frequencies[(size_t)lowerBin];
+            auto upperFreq = frequencies[(size_t)upperBin];
 
-    Fifo<BlockType> fftDataFifo;
+            bins.start = bins.end = lowerBin;
+            bins.fraction = std::log(pixelFreq / lowerFreq) / std::log(upperFreq / lowerFreq);
+        }
+    }
+
+    // False if nothing of the spectrum falls on this pixel   ~A
+    bool getValue(const std::vector<float>& data, int pixel, float& value) const
+    {
+        const auto& bins = pixels[(size_t)pixel];
+
+        if (bins.end > bins.start)
+        {
+            value = data[(size_t)bins.start];
+            for (int bin = bins.start + 1; bin < bins.end; ++bin)
+                value = juce::jmax(value, data[(size_t)bin]);
+            return true;
+        }
+
+        if (bins.start >= 0)
+        {
+            value = data[(size_t)bins.start] + bins.fraction * (data[(size_t)bins.start + 1] - data[(size_t)bins.start]);
+            return true;
+        }
+
+        return false;
+    }
+private:
+    // The bins [start, end) that land on a pixel. A pixel without bins of its own
+    // has end == start and interpolates from 'start' towards the next bin by
+    // 'fraction'. start < 0 means there's nothing to draw there   ~A
+    struct PixelBins
+    {
+        int start = -1, end = -1;
+        float fraction = 0.f;
+    };
 
+    std::vector<PixelBins> pixels;
+    int mappedPixels = 0, mappedLayoutVersion = -1;
+};
+
+// A trace with exactly one y per pixel column, left to right. Non-finite values
+// mark columns with nothing to draw, the line has a gap there   ~A
+using Polyline = std::vector<float>;
+
+// Draws a Polyline straight into an ARGB image. Every column gets the vertical
+// span the line covers between the halfway points to its neighbours, widened by
+// the thickness, and each pixel is blended by how much of it that span covers.
+// For lines that only ever move forward in x this looks the same as stroking a
+// juce::Path, without the Path, the flattener, the stroker or any allocation   ~A
+struct PolylineRenderer
+{
+    // Column 0 lands on x = 'left', every y gets 'top' added. Everything is in image
+    // pixels, so on a HiDPI layer the polyline needs one point per physical column   ~A
+    static void draw(juce::Image::BitmapData& pixels,
+                     const Polyline& polyline,
+                     int left,
+                     float top,
+                     juce::Colour colour,
+                     float thickness);
 };
 
 // Spectrum analyser path generator based on FFT data   ~A
-template<typename PathType>
 struct AnalyzerPathGenerator
 {
-    // Converts 'renderData[]' into a juce::Path
+    // Converts 'renderData[]' into a Polyline with one point per pixel column.
+    // 'frequencies' holds the centre frequency of every entry, they don't
+    // have to be evenly spaced, see PixelBinMap   ~A
     void generatePath(const std::vector<float>& renderData,
+                      const std::vector<float>& frequencies,
+                      int layoutVersion,
                       juce::Rectangle<float> fftBounds,
-                      int fftSize,
-                      float binWidth,
                       float negativeInfinity)
     {
+        jassert(renderData.size() >= frequencies.size());
+
         auto top = fftBounds.getY();
         auto bottom = fftBounds.getHeight();
-        auto width = fftBounds.getWidth();
+        auto width = (int)fftBounds.getWidth();
+
+        if (frequencies.empty() || width <= 0)
+            return;
 
-        int numBins = (int)fftSize / 2;
+        if (!columnMap.isUpToDate(width, layoutVersion))
+            columnMap.update(frequencies, width, layoutVersion);
 
-        PathType p;
-        p.preallocateSpace(3 * (int)fftBounds.getWidth());
+        // Reusing the storage the fifo handed back last time, it only grows with the window  ~A
+        auto& ys = workingPath;
+        ys.resize((size_t)width);
 
         auto map = [bottom, top, negativeInfinity](float v)
         {
@@ -108,29 +419,20 @@ struct AnalyzerPathGenerator
                               float(bottom), top);
         };
 
-        auto y = map(renderData[0]);
-
-        jassert(!std::isnan(y) && !std::isinf(y));
-
-        p.startNewSubPath(0, y);
-
-        const int pathResolution = 2;
-
-        for (int binNum = 1; binNum < numBins; binNum += pathResolution)
+        for (int column = 0; column < width; ++column)
         {
-            y = map(renderData[binNum]);
-
-            jassert(!std::isnan(y) && !std::isinf(y));
-
-            if (!std::isnan(y) && !std::isinf(y))
+            float value;
+            if (columnMap.getValue(renderData, column, value))
             {
-                auto binFreq = binNum * binWidth;
-                auto normalizedBinX = juce::mapFromLog10(binFreq, 20.f, 20000.f);
-                int binX = std::floor(normalizedBinX * width);
-                p.lineTo(binX, y);
+                ys[(size_t)column] = map(value);
+                jassert(std::isfinite(ys[(size_t)column]));
+            }
+            else
+            {
+                ys[(size_t)column] = std::numeric_limits<float>::quiet_NaN();
             }
         }
-        pathFifo.push(p);
+        pathFifo.push(ys);
     }
 
     int getNumPathsAvailable() const
@@ -138,18 +440,72 @@ struct AnalyzerPathGenerator
         return pathFifo.getNumAvailableForReading();
     }
 
-    bool getPath(PathType& path)
+    // 'path' gets swapped with the queued one, its old storage is reused next time  ~A
+    bool getPath(Polyline& path)
     {
         return pathFifo.pull(path);
     }
 private:
-    Fifo<PathType> pathFifo;
+    Fifo<Polyline> pathFifo;
+    Polyline workingPath;
+    PixelBinMap columnMap;
+};
+
+// Spectrogram columns. Every new analyzer frame becomes one column of colours,
+// lowest frequency at the bottom, looked up in a colour table built once up front.
+// The message thread only copies the finished columns into the image   ~A
+struct SpectrogramColumnGenerator
+{
+    SpectrogramColumnGenerator();
+
+    // One colour per row, from decibels on the analyzer's scale   ~A
+    void generateColumn(const std::vector<float>& renderData,
+                        const std::vector<float>& frequencies,
+                        int layoutVersion,
+                        int height,
+                        float negativeInfinity);
+
+    int getNumColumnsAvailable() const { return columnFifo.getNumAvailableForReading(); }
+    bool getColumn(std::vector<juce::PixelARGB>& column) { return columnFifo.pull(column); }
+
+    static constexpr int maxHeight = 512;
+    static constexpr int colourTableSize = 256;
+private:
+    std::array<juce::PixelARGB, colourTableSize> colourTable;
+    PixelBinMap rowMap;
+    std::vector<juce::PixelARGB> workingColumn;
+    Fifo<std::vector<juce::PixelARGB>> columnFifo;
 };
 
+// A scrolling spectrogram. The image is a ring of columns, each new column
+// overwrites the oldest one and painting draws the ring in two parts, so the cost
+// per frame stays the same however long it runs   ~A
+struct SpectrogramDisplay : juce::Component
+{
+    SpectrogramDisplay();
+
+    // Message thread only. Writes one column and repaints   ~A
+    void pushColumn(const std::vector<juce::PixelARGB>& column);
+    void clear();
 
+    // Read by the analyzer worker to size the columns   ~A
+    int getColumnHeight() const { return columnHeight.load(); }
+
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+private:
+    juce::Image ring;
+    int writeColumn = 0;
+    std::atomic<int> columnHeight{ 0 };
+
+    juce::Rectangle<int> getImageArea() const;
+};
 
 //=============================================================================
 // Adding a look&feel class that will allow editing the area inside the custom knob ~A
+// One of these is shared by every knob and button of every open editor, held through
+// a juce::SharedResourcePointer. The knobs come from filmstrips: every angle is
+// rendered once per size and display scale, so painting a knob blits one frame   ~A
 struct LookAndFeel : juce::LookAndFeel_V4
 {
     virtual void drawRotarySlider(juce::Graphics&,
@@ -163,6 +519,33 @@ struct LookAndFeel : juce::LookAndFeel_V4
                                   juce::ToggleButton& toggleButton,
                                   bool shouldDrawButtonAsHighlighted,
                                   bool shouldDrawButtonAsDown) override;
+
+    // Message thread only. 'proportion' goes from 0 at the start angle to 1 at the end   ~A
+    void drawKnobFrame(juce::Graphics& g, juce::Rectangle<int> bounds, float proportion);
+
+    // Making the knobs have starting value at 7 o'clock and ending value at 5 o'clock  ~A
+    static float getKnobStartAngle() { return juce::degreesToRadians(180.f + 45.f); }
+    static float getKnobEndAngle() { return juce::degreesToRadians(180.f - 45.f) + juce::MathConstants<float>::twoPi; }
+
+    // 270 degrees in 128 steps is about 2 degrees per frame   ~A
+    static constexpr int numKnobFrames = 128;
+    static constexpr int knobFramesPerRow = 16;
+private:
+    static void drawKnob(juce::Graphics& g, juce::Rectangle<float> bounds, float angle);
+
+    // The outline is stroked on the knob's edge, so every frame has some room around it   ~A
+    static constexpr int knobFrameMargin = 3;
+
+    struct KnobFilmstrip
+    {
+        int size;
+        float scale;
+        int framePixels;
+        juce::Image frames;
+    };
+
+    const KnobFilmstrip& getKnobFilmstrip(int size, float scale);
+    std::vector<KnobFilmstrip> knobFilmstrips;
 };
 
 
@@ -176,7 +559,7 @@ struct MyEQKnob1 : juce::Slider
         suffix(unitSuffix)
 
     {
-        setLookAndFeel(&lnf);
+        setLookAndFeel(lnf.get());
     }
 
     ~MyEQKnob1()
@@ -198,47 +581,369 @@ struct MyEQKnob1 : juce::Slider
     int getTextHeight() const { return 14; }
     juce::String getDisplayString() const;
 private:
-    LookAndFeel lnf;
+    juce::SharedResourcePointer<LookAndFeel> lnf;
     juce::RangedAudioParameter* aParam;
     juce::String suffix;
+
+    // The labels are laid out again only when the size or the labels change,
+    // painting just draws the glyphs   ~A
+    void layOutLabels();
+    juce::GlyphArrangement labelGlyphs;
+    juce::Rectangle<int> labelGlyphBounds;
+    int numLabelsLaidOut = -1;
+};
+
+// Halfband lowpass followed by dropping every other sample, feeding the
+// decimated analyzer stages below. Every other tap of a halfband filter is zero,
+// so only the non zero ones are kept and computed    ~A
+struct HalfBandDecimator
+{
+    HalfBandDecimator();
+
+    void reset();
+
+    // Output can be the same array as input. Returns the number of samples written  ~A
+    int process(const float* input, int numSamples, float* output);
+
+    // Fraction of the new Nyquist frequency that is flat and free of aliasing   ~A
+    static constexpr float usableBandwidth = 0.85f;
+private:
+    // The odd taps either side of the centre plus the centre itself   ~A
+    static constexpr int numTaps = 95;
+    static constexpr int numNonZeroTaps = (numTaps + 1) / 2 + 1;
+    static_assert((numTaps - 3) % 4 == 0, "the centre tap of the halfband has to sit on an odd offset");
+
+    std::array<int, numNonZeroTaps> tapIndices;
+    std::array<float, numNonZeroTaps> tapGains;
+
+    // Written twice so the taps always read one contiguous run   ~A
+    std::array<float, numTaps * 2> delayLine;
+    int newest = 0;
+    bool oddSample = false;
 };
 
+// Analyzes both channels together, see FFTDataGenerator, and turns them into one
+// or two traces depending on the analyzer mode. Optionally also the input before
+// the EQ and the difference between output and input, taken from the same capture
+// ring and run through the same FFTs   ~A
 struct PathProducer
 {
-    PathProducer(SingleChannelSampleFifo<EQ_LiteAudioProcessor::BlockType>& scsf) :
-    leftChannelFifo(&scsf)
-    {
-        /*
-         If samplerate is 48000 then the resolution for the order of 2048
-         equals 48000 / 2048 = 23 Hz. That might make the low end resolution
-         a bit lacking. Is there a way to gradually lower the resolution as the
-         sound frequence increases?      ~A
-         */
-
-        leftChannelFFTDataGenerator.changeOrder(FFTOrder::order2048);
-        monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
-    }
-    void process(juce::Rectangle<float> fftBound, double sampleRate);
-    juce::Path getPath() { return leftChannelFFTPath; }
+    PathProducer(SampleRingBuffer& captureRing);
+
+    // Runs on the analyzer worker, once per display frame. Returns the number of FFTs done.
+    // Every new spectrum also becomes a spectrogram column 'spectrogramHeight' rows tall   ~A
+    int process(juce::Rectangle<float> fftBound, int spectrogramHeight, double sampleRate, const AnalyzerSettings& settings);
+
+    // Throwing away everything collected so far, used when the analyzer restarts  ~A
+    void reset();
+
+    // Message thread side: picking up the newest finished paths, or dropping them   ~A
+    bool pullLatestPaths();
+    void clearPaths();
+    const Polyline& getPath(int trace) const { return traces[(size_t)trace].path; }
+    const Polyline& getPeakPath(int trace) const { return traces[(size_t)trace].peakPath; }
+    const Polyline& getPreEQPath() const { return preEQTrace.path; }
+    const Polyline& getDifferencePath() const { return differencePath; }
+
+    // Every column counts here, not just the newest, so these are pulled one by one   ~A
+    bool pullSpectrogramColumn(std::vector<juce::PixelARGB>& column) { return spectrogramColumns.getColumn(column); }
+
+    /*
+     If samplerate is 48000 then the resolution for the order of 2048
+     equals 48000 / 2048 = 23 Hz. That might make the low end resolution
+     a bit lacking. Is there a way to gradually lower the resolution as the
+     sound frequence increases?      ~A
+
+     There is: every stage below runs the same size FFT, but each one gets the
+     signal decimated by another factor of 2. Stage 0 shows the top octaves,
+     stage 1 the octave below them with twice the resolution, and the last stage
+     everything down to 20 Hz with 4 times the resolution - the low end of an
+     8192 point FFT for the price of three 2048 point ones. At 96 and 192 kHz the
+     input gets decimated before stage 0 as well, so no bins are wasted above 20 kHz  ~A
+     */
+    static constexpr int numStages = 3;
+    static constexpr int maxBaseDecimations = 3;
+    static constexpr int maxNumTraces = 2;
+
+    // Paths are only generated again once what's shown moved by more than this,
+    // so a steady or silent input lets the display idle   ~A
+    static constexpr float changeThresholdDB = 0.5f;
     
 private:
+    using Generator = FFTDataGenerator<std::vector<float>>;
+    using ChannelDecimators = std::array<HalfBandDecimator, NumAnalyzedChannels>;
+
+    struct AnalyzerStage
+    {
+        // Feeds this stage from the one above, stage 0 doesn't use them   ~A
+        ChannelDecimators decimators;
+        SampleRingBuffer history;
+        juce::int64 frameEnd = 0;
+
+        Generator fftDataGenerator;
+
+        // Newest spectra of this stage, laid out like the fifo slots, see SpectrumSlot   ~A
+        std::vector<float> fftData;
+
+        // The part of this stage's spectrum that ends up on screen   ~A
+        int firstBin = 0, numBins = 0;
+    };
+
+    // Everything after the FFT happens once per trace   ~A
+    struct AnalyzerTrace
+    {
+        // All stages glued together, from 20 Hz up   ~A
+        std::vector<float> stitchedData;
+
+        SpectrumPostProcessor postProcessor{ numStages * Generator::maxFFTSize / 2 };
+
+        AnalyzerPathGenerator pathProducer, peakPathProducer;
+
+        Polyline path, peakPath;
+    };
+
     // Doing the convoluted spectrum analyser work  ~A
-    SingleChannelSampleFifo<EQ_LiteAudioProcessor::BlockType>* leftChannelFifo;
+    SampleRingBuffer* captureFifo;
 
-    juce::AudioBuffer<float> monoBuffer;
+    // How far into the capture ring the decimation chains have read   ~A
+    juce::int64 readPosition = 0;
 
-    FFTDataGenerator<std::vector<float>> leftChannelFFTDataGenerator;
+    std::array<ChannelDecimators, maxBaseDecimations> baseDecimators;
+    int numBaseDecimations = 0;
+    std::array<AnalyzerStage, numStages> stages;
 
-    AnalyzerPathGenerator<juce::Path> pathProducer;
+    static constexpr int chunkSize = 4096;
+    std::array<std::vector<float>, NumAnalyzedChannels> chunks;
+    std::array<float*, NumAnalyzedChannels> chunkPointers;
+    std::vector<float> preEQRightChunk;
 
-    juce::Path leftChannelFFTPath;
+    // Which bins of which stage cover which part of 20 Hz - 20 kHz. The version
+    // tells the path generators their pixel column maps are out of date  ~A
+    void updateLayout(double sampleRate, FFTOrder order);
+    double layoutSampleRate = 0;
+    int layoutVersion = 0;
+
+    void pushIntoStages(int numSamples);
+
+    std::vector<float> stitchedFrequencies;
+    void stitchStages(int slot, std::vector<float>& destination);
+
+    std::array<AnalyzerTrace, maxNumTraces> traces;
+    AnalyzerTrace preEQTrace;
+
+    // The output summed like the input, only needed separately when the traces
+    // don't show the sum already   ~A
+    std::vector<float> postEQSumData;
+    SpectrumPostProcessor postEQSumProcessor{ numStages * Generator::maxFFTSize / 2 };
+
+    // Output minus input in decibels, drawn on the response curve's scale   ~A
+    std::vector<float> differenceData;
+    AnalyzerPathGenerator differencePathProducer;
+    Polyline differencePath;
+
+    void produceDifference(juce::Rectangle<float> fftBounds);
+
+    // The louder of the traces at every bin   ~A
+    std::vector<float> spectrogramData;
+    SpectrogramColumnGenerator spectrogramColumns;
+
+    // What the last published paths were made from   ~A
+    struct PublishedState
+    {
+        std::array<std::vector<float>, maxNumTraces> averages, peaks;
+        std::vector<float> preEQ;
+        juce::Rectangle<float> bounds;
+        int layoutVersion = -1;
+        int mode = -1;
+        bool peakHold = false, withPreEQ = false;
+    };
+
+    PublishedState published;
+    bool needsPublishing(juce::Rectangle<float> fftBounds, const AnalyzerSettings& settings, int numTraces, bool withPreEQ);
+
+    // The averages and peaks of one mode mean nothing in another   ~A
+    int analyzerMode = AnalyzerMode::Mode_LeftRight;
+
+    // Turning the input on or off restarts the analysis, so the decimators of the
+    // input never have to catch up on stale history   ~A
+    int numAnalyzedChannels = AnalyzedPreEQ;
+
+    int fifoGeneration = 0;
+};
+
+// Anything the shared analyzer worker below can run in the background   ~A
+struct AnalyzerClient
+{
+    virtual ~AnalyzerClient() = default;
+
+    // Catching up with the audio, at most one FFT frame per analysis stage since
+    // only the newest one gets shown. Returns how many frames were done  ~A
+    virtual int runAnalysis() = 0;
+};
+
+// One background thread shared by every EQ_Lite instance in the process, held through
+// a juce::SharedResourcePointer. It does the FFT and path work for all open editors,
+// so the message thread only paints. Each pass starts with a different client, every
+// client does at most one frame per analysis stage, and the pass stops early once
+// the global budget is spent, so one busy instance can't starve the others     ~A
+struct AnalyzerWorker : juce::Thread
+{
+    AnalyzerWorker();
+    ~AnalyzerWorker() override;
+
+    void addClient(AnalyzerClient* client);
+    void removeClient(AnalyzerClient* client);
+
+    void run() override;
+
+    static constexpr int passIntervalMs = 1000 / 60;
+    static constexpr double passBudgetMs = 8.0;
+
+    // When no client had a single frame to do, there's no audio coming in, so the
+    // thread backs off until then or until someone calls notify()   ~A
+    static constexpr int idleIntervalMs = 100;
+private:
+    juce::CriticalSection clientLock;
+    juce::Array<AnalyzerClient*> clients;
+    int firstClient = 0;
+
+    // The worker's own copy of 'clients' for the current pass   ~A
+    juce::Array<AnalyzerClient*> passClients;
+};
+
+// Anything the shared frame clock below can tick on the message thread   ~A
+struct FrameClockClient
+{
+    virtual ~FrameClockClient() = default;
+
+    // Returns how many milliseconds until it wants to be ticked again  ~A
+    virtual int frameTick() = 0;
+};
+
+// One message thread timer shared by every open EQ_Lite editor, held through a
+// juce::SharedResourcePointer. Each client asks for its own next tick, the timer
+// only fires when the earliest one is due and never faster than one frame, so
+// all busy editors repaint on the same frames and idle ones cost nothing   ~A
+struct FrameClock : juce::Timer
+{
+    void addClient(FrameClockClient* client);
+    void removeClient(FrameClockClient* client);
+
+    // Ticks the client on the next frame, whatever it asked for last time  ~A
+    void wake(FrameClockClient* client);
+
+    void timerCallback() override;
+
+    static constexpr int frameIntervalMs = 1000 / 60;
+private:
+    void scheduleNextTick();
+
+    struct Entry
+    {
+        FrameClockClient* client;
+        double nextTickMs;
+    };
+
+    std::vector<Entry> entries;
+    double lastTickMs = 0;
+    double lastReportMs = 0;
+};
+
+// Opt-in measurements of what the UI costs, compiled out unless the project defines
+// EQ_LITE_UI_PROFILING=1, which the benchmark in Benchmarks/ does. Every measured
+// section collects its calls, time and heap allocations, and the frame clock logs a
+// summary every few seconds. renderFrames() paints any component into an offscreen
+// image, the benchmark uses it to time sizes and scales   ~A
+#ifndef EQ_LITE_UI_PROFILING
+ #define EQ_LITE_UI_PROFILING 0
+#endif
+
+struct UIProfiler
+{
+    enum Section
+    {
+        ResponseCurvePaint,
+        KnobPaint,
+        PathProducerProcess,
+        EditorBackground,
+        NumSections
+    };
+
+    struct ScopedMeasurement
+    {
+        explicit ScopedMeasurement(Section sectionToMeasure);
+        ~ScopedMeasurement();
+    private:
+        Section section;
+        juce::int64 startTicks;
+        juce::uint64 startAllocations;
+    };
+
+    // One line per section, then everything starts from zero again   ~A
+    static juce::String getReportAndReset();
+
+    // Paints 'component' 'numFrames' times into an image at 'scale', returns milliseconds per frame   ~A
+    static double renderFrames(juce::Component& component, int numFrames, float scale);
+
+    // Allocations on the calling thread, zero unless a counter was installed   ~A
+    static juce::uint64 getAllocationCount();
+
+    using AllocationCounter = juce::uint64 (*)();
+    static void setAllocationCounter(AllocationCounter counter);
+
+    static constexpr int reportIntervalMs = 5000;
+private:
+    struct Totals
+    {
+        std::atomic<juce::int64> calls{ 0 }, ticks{ 0 }, allocations{ 0 };
+    };
+
+    static std::array<Totals, NumSections>& getTotals();
+};
+
+#if EQ_LITE_UI_PROFILING
+ #define EQ_LITE_PROFILE_UI(section) const UIProfiler::ScopedMeasurement uiProfilerMeasurement (UIProfiler::section)
+#else
+ #define EQ_LITE_PROFILE_UI(section)
+#endif
+
+// The response of every band over the display's frequency grid, kept between
+// updates. Only a band whose sections changed gets evaluated again, the curve is
+// the product of all of them, bands that are switched off left out. The evaluation uses
+//     |H|^2 = ((b0+b1+b2)^2 - 4(b0b1 + 4b0b2 + b1b2)p + 16b0b2p^2) / (same with 1, a1, a2)
+// with p = sin^2(w/2) precomputed per pixel, so the loop is a few multiply-adds
+// on contiguous floats that the compiler vectorizes. Writing it in p instead of
+// cos(w) keeps it accurate for the low cut's poles right next to DC   ~A
+struct BandResponseCache
+{
+    static constexpr int numBands = CoefficientSnapshot::numBands;
+
+    // Does nothing unless the width or the sample rate changed   ~A
+    void setGrid(int numPoints, double sampleRate);
+
+    void setBand(int band, const BandSections& sections);
+
+    // The whole curve in decibels, one value per pixel   ~A
+    const std::vector<float>& getDecibels();
+private:
+    static void multiplyBiquadPower(float* power, const float* p, int numPoints, const std::array<double, 5>& section);
+
+    int gridPoints = 0;
+    double gridSampleRate = 0;
+    std::vector<float> sinSquaredHalfOmega, totalPower, decibels;
+
+    std::array<std::vector<float>, numBands> bandPower;
+    std::array<BandSections, numBands> bandSections;
+    std::array<bool, numBands> bandNeedsUpdate{};
+    bool totalNeedsUpdate = true;
 };
 
 // Creating a response curve window as a separate component obj so it doesn't draw outside the bounds   ~A
 
 struct ResponseCurveWindow : juce::Component,
     juce::AudioProcessorParameter::Listener,
-    juce::Timer
+    FrameClockClient,
+    AnalyzerClient
 {
     ResponseCurveWindow(EQ_LiteAudioProcessor&);
     ~ResponseCurveWindow();
@@ -247,14 +952,19 @@ struct ResponseCurveWindow : juce::Component,
 
     void parameterGestureChanged(int parameterIndex, bool gestureIsStarting) override {};
 
-    void timerCallback() override;
+    int frameTick() override;
+
+    int runAnalysis() override;
 
     void paint(juce::Graphics& g) override;
 
     void resized() override;
 
-    
-    
+    void visibilityChanged() override;
+
+    void parentHierarchyChanged() override;
+
+    SpectrogramDisplay& getSpectrogram() { return spectrogram; }
 
     
 
@@ -264,16 +974,29 @@ private:
     // Creating an atomic flag to decide if the component needs repainting  ~A
     juce::Atomic<bool> parametersChanged{ false };
 
-    MonoChain monoChain;
-
     // A simple member to pass AllBypassed button toggle state to paint function ~A
-    bool allBypassed;
+    bool allBypassed = false;
    
-    // Creating a function that will update the response curve the first time
-    // GUI is displayed     ~A
-    void updateChain();
-
-    juce::Image responseBackground;
+    // Picking up the coefficients the processor published, see CoefficientSnapshot.
+    // Returns true if they changed since the last time   ~A
+    bool updateChain();
+    juce::uint32 chainVersion = 0;
+
+    // The magnitudes and the path only change with the chain or the size, so
+    // they're kept between repaints   ~A
+    void updateResponseCurve();
+    BandResponseCache responseCache;
+    Polyline responseCurve;
+
+    // Layers: grid, labels and outline, then the analyzer, then the response curve.
+    // The two on top are drawn with the PolylineRenderer only when they change.
+    // All three have the physical pixels of the display the window was last painted on   ~A
+    juce::Image responseBackground, analyzerLayer, curveLayer;
+    float layerScale = 1.f;
+    void createLayers();
+    void renderCurveLayer();
+    void renderAnalyzerLayer();
+    bool analyzerPathsShown = false;
 
     // A function to return the slightly shrunken response window render area   ~A
     juce::Rectangle<int> getRenderArea();
@@ -283,7 +1006,31 @@ private:
     juce::Rectangle<int> getAnalysisArea();
 
     // Creating a spectrum analyser path producer for both channels     ~A
-    PathProducer leftPathProducer, rightPathProducer;
+    PathProducer pathProducer;
+
+    // Fed from the same analyzer frames. The editor places it, we own it so the
+    // worker and the timer here can reach it    ~A
+    SpectrogramDisplay spectrogram;
+    std::vector<juce::PixelARGB> spectrogramColumn;
+
+    // Reporting on-screen state to the processor and tracking the analyzer switch   ~A
+    void updateAnalyzerShowing();
+    bool analyzerRunning = false;
+
+    // Where the worker draws the spectrum paths, set on the message thread in resized()  ~A
+    juce::SpinLock analyzerBoundsLock;
+    juce::Rectangle<float> analyzerBounds;
+
+    juce::SharedResourcePointer<AnalyzerWorker> analyzerWorker;
+
+    // Pacing: every frame while the curve or the traces move and for a little
+    // while after, then a slow poll, and slower still while not on screen   ~A
+    static constexpr int activityHoldMs = 500;
+    static constexpr int idleIntervalMs = 100;
+    static constexpr int hiddenIntervalMs = 500;
+    double lastActivityMs = 0;
+
+    juce::SharedResourcePointer<FrameClock> frameClock;
 
   
 
@@ -346,7 +1093,30 @@ private:
 
     std::vector<juce::Component*> getComponents();
 
-    LookAndFeel lnf;
+    static constexpr int spectrogramHeight = 100;
+
+    // Preset bar between the knobs and the spectrogram: the bank, saving into it and
+    // the A/B/C/D comparison slots   ~A
+    static constexpr int presetBarHeight = 30;
+    juce::ComboBox presetBox;
+    juce::TextButton savePresetButton { "Save" };
+    std::array<juce::TextButton, EQ_LiteAudioProcessor::numComparisonSlots> comparisonButtons;
+
+    // Morph controls on the same bar, capturing the two ends and moving between them   ~A
+    juce::ToggleButton morphEnabledButton { "Morph" };
+    std::array<juce::TextButton, EQ_LiteAudioProcessor::numMorphEnds> morphEndButtons;
+    juce::Slider morphSlider { juce::Slider::LinearHorizontal, juce::Slider::NoTextBox };
+    ButtonAttachment morphEnabledButtonAttachment;
+    Attachment morphSliderAttachment;
+
+    void updateMorphEndButtons();
+
+    void refreshPresetList();
+    void savePresetAs();
+
+    juce::Image backgroundTexture;
+
+    juce::SharedResourcePointer<LookAndFeel> lnf;
 
     
 
@@ -10,6 +10,123 @@
 #include "PluginEditor.h"
 
 //==============================================================================
+juce::String getBandParameterID(int band, BandField field)
+{
+    static const char* const fieldNames[] = { "Freq", "Gain", "Quality", "Bypassed" };
+    return "Band" + juce::String(band + 1) + " " + fieldNames[field];
+}
+
+// The EQ parameters in the order presets and morph ends store them. The first part
+// is what presets held before the extra peak bands, those follow with all their
+// fields each. Only ever append to this table either   ~A
+static const juce::StringArray& getPresetParameterIDs()
+{
+    static const auto ids = []
+    {
+        juce::StringArray table
+        {
+            "LowCut Freq", "HiCut Freq",
+            "Band1 Freq", "Band1 Gain", "Band1 Quality",
+            "Band2 Freq", "Band2 Gain", "Band2 Quality",
+            "Band3 Freq", "Band3 Gain", "Band3 Quality",
+            "LowCut Slope", "HiCut Slope",
+            "Output Gain",
+            "LowCut Bypassed", "Band1 Bypassed", "Band2 Bypassed", "Band3 Bypassed", "HighCut Bypassed", "All Bypassed"
+        };
+        jassert(table.size() == EQ_LiteAudioProcessor::numPresetValuesBeforeExtraBands);
+
+        for (int band = numEditorBands; band < maxPeakBands; ++band)
+            for (int field = 0; field < NumBandFields; ++field)
+                table.add(getBandParameterID(band, (BandField)field));
+
+        jassert(table.size() == EQ_LiteAudioProcessor::numPresetValues);
+        return table;
+    }();
+
+    return ids;
+}
+
+// Every parameter in the order the binary state stores them. Only ever append to
+// this table: the place of an ID here is where its value sits in every saved session.
+// The extra peak bands came last, after the morph   ~A
+static const juce::StringArray& getStateParameterIDs()
+{
+    static const auto ids = []
+    {
+        const auto& presetIDs = getPresetParameterIDs();
+        const auto numBefore = EQ_LiteAudioProcessor::numPresetValuesBeforeExtraBands;
+
+        juce::StringArray table;
+        table.addArray(presetIDs, 0, numBefore);
+        table.addArray(juce::StringArray
+        {
+            "Analyzer Enabled", "Analyzer Overlap", "Analyzer Resolution", "Analyzer Smoothing",
+            "Analyzer Averaging", "Analyzer Peak Hold", "Analyzer Mode", "Analyzer Pre EQ",
+            "Morph Enabled", "Morph Position"
+        });
+        table.addArray(presetIDs, numBefore);
+        return table;
+    }();
+
+    return ids;
+}
+
+// The parameters that feed ChainSettings, the only ones whose changes need the
+// filters redesigned. The analyzer settings and the morph position stay out   ~A
+static const juce::StringArray& getFilterParameterIDs()
+{
+    static const auto ids = []
+    {
+        auto table = getPresetParameterIDs();
+        table.add("Morph Enabled");
+        return table;
+    }();
+
+    return ids;
+}
+
+// Where each setting sits in the preset table, looked up once   ~A
+struct PresetIndices
+{
+    int lowCutFreq, highCutFreq, lowCutSlope, highCutSlope, outputGain;
+    int lowCutBypassed, highCutBypassed, allBypassed;
+    std::array<std::array<int, NumBandFields>, maxPeakBands> bands;
+};
+
+static const PresetIndices& getPresetIndices()
+{
+    static const auto indices = []
+    {
+        const auto& ids = getPresetParameterIDs();
+        PresetIndices result;
+
+        result.lowCutFreq = ids.indexOf("LowCut Freq");
+        result.highCutFreq = ids.indexOf("HiCut Freq");
+        result.lowCutSlope = ids.indexOf("LowCut Slope");
+        result.highCutSlope = ids.indexOf("HiCut Slope");
+        result.outputGain = ids.indexOf("Output Gain");
+        result.lowCutBypassed = ids.indexOf("LowCut Bypassed");
+        result.highCutBypassed = ids.indexOf("HighCut Bypassed");
+        result.allBypassed = ids.indexOf("All Bypassed");
+
+        for (int band = 0; band < maxPeakBands; ++band)
+            for (int field = 0; field < NumBandFields; ++field)
+                result.bands[(size_t)band][(size_t)field] = ids.indexOf(getBandParameterID(band, (BandField)field));
+
+        return result;
+    }();
+
+    return indices;
+}
+
+// Converting a value saved by an older layout version to what it means now.
+// Versions 2 and 3 only appended, so there's nothing to convert yet   ~A
+static float migrateStateValue(int savedVersion, int index, float value)
+{
+    juce::ignoreUnused(savedVersion, index);
+    return value;
+}
+
 EQ_LiteAudioProcessor::EQ_LiteAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
      : AudioProcessor (BusesProperties()
@@ -22,10 +139,37 @@ EQ_LiteAudioProcessor::EQ_LiteAudioProcessor()
                        )
 #endif
 {
+    analyzerEnabled = apvts.getRawParameterValue("Analyzer Enabled");
+    morphEnabled = apvts.getRawParameterValue("Morph Enabled");
+    morphPosition = apvts.getRawParameterValue("Morph Position");
+
+    // The capture ring gets its storage once, an open editor's analyzer worker may
+    // be reading it whenever prepareToPlay() comes along   ~A
+    analyzerCapture.allocate(CaptureChannel::NumCaptureChannels, SampleRingBuffer::captureCapacity);
+
+    // Building the lookup tables here rather than on the audio thread   ~A
+    const auto& presetIDs = getPresetParameterIDs();
+    for (int index = 0; index < numPresetValues; ++index)
+        eqParameters[(size_t)index] = apvts.getRawParameterValue(presetIDs[index]);
+    getPresetIndices();
+
+    // The morph position gets read every block anyway, automating it at audio rate
+    // shouldn't redesign the whole chain on top of that. The analyzer settings
+    // never reach the filters at all   ~A
+    for (auto& parameterID : getFilterParameterIDs())
+        apvts.addParameterListener(parameterID, this);
 }
 
 EQ_LiteAudioProcessor::~EQ_LiteAudioProcessor()
 {
+    for (auto& parameterID : getFilterParameterIDs())
+        apvts.removeParameterListener(parameterID, this);
+}
+
+void EQ_LiteAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(parameterID, newValue);
+    parameterGeneration.fetch_add(1, std::memory_order_acq_rel);
 }
 
 //==============================================================================
@@ -103,16 +247,24 @@ void EQ_LiteAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBloc
     specs.numChannels = 1;
     specs.sampleRate = sampleRate;
     
-    leftChain.prepare(specs);
-    rightChain.prepare(specs);
+    for (auto* chain : { &leftChain, &rightChain, &outgoingLeftChain, &outgoingRightChain })
+    {
+        prepareChainStages(*chain);
+        chain->prepare(specs);
+    }
+
+    outgoingBuffer.setSize(2, samplesPerBlock);
+    switchFadeLength = juce::roundToInt(sampleRate * switchFadeSeconds);
+    switchFadePosition = switchFadeLength;
 
     // Helper function to update all the filters (check its declaration)     ~A
 
+    appliedParameterGeneration = parameterGeneration.load(std::memory_order_acquire);
     updateFilters();
+    wasMorphing = false;
 
-    // Preparing the fifos for spectrum analyser    ~A
-    leftChannelFifo.prepare(samplesPerBlock);
-    rightChannelFifo.prepare(samplesPerBlock);
+    // Preparing the capture ring for spectrum analyser    ~A
+    analyzerCapture.prepare(samplesPerBlock);
 }
 
 void EQ_LiteAudioProcessor::releaseResources()
@@ -162,25 +314,103 @@ void EQ_LiteAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // Helper function to update all the filters (check its declaration)     ~A
+    // Helper function to update all the filters (check its declaration). Only after
+    // a parameter changed, i.e. when the generation moved on since the last design.
+    // Nothing changes during a preset fade. A preset sets its parameters one by one
+    // first, none of which may reach the filters on their own, and then publishes
+    // its switch tagged with the generation it covers. So while it's setting them
+    // we wait, and a switch leaves only what changed after it for updateFilters().
+    // While morphing the morph drives the filters, the parameters take over again
+    // once it's switched off   ~A
+    auto morphing = false, morphChanged = false;
+    if (!isSwitchFading())
+    {
+        const auto generation = parameterGeneration.load(std::memory_order_acquire);
+        auto needsUpdate = generation != appliedParameterGeneration
+                           && !switchingParameters.load(std::memory_order_acquire);
+
+        if (pendingSwitches.pull())
+        {
+            const auto& pendingSwitch = pendingSwitches.getReadBuffer();
+            startSwitchFade(pendingSwitch.design);
+
+            // Whatever changed after the switch waits for the end of the fade   ~A
+            appliedParameterGeneration = pendingSwitch.parameterGeneration;
+            needsUpdate = false;
+        }
+        else if (needsUpdate)
+        {
+            appliedParameterGeneration = generation;
+        }
+
+        morphChanged = morphSettings.pull();
+        morphing = morphEnabled->load() > 0.5f && morphSettings.getReadBuffer().isValid();
+
+        if (morphing)
+            morphChanged = morphChanged || !wasMorphing;
+        else if (needsUpdate || wasMorphing)
+            updateFilters();
+
+        wasMorphing = morphing;
+    }
 
-    updateFilters();
+    const auto fading = isSwitchFading();
+    const auto numSamples = buffer.getNumSamples();
+    if (fading)
+    {
+        outgoingBuffer.setSize(2, numSamples, false, false, true);
+        for (int ch = 0; ch < 2; ++ch)
+            outgoingBuffer.copyFrom(ch, 0, buffer, juce::jmin(ch, buffer.getNumChannels() - 1), 0, numSamples);
+    }
     
+    // Capturing for the analyzer only if it's switched on and someone can actually
+    // see it. The input goes into the ring before the chains run, but the reader
+    // only gets to see it together with the output once the block is published  ~A
+    auto analyzerCapturing = analyzerEnabled->load() > 0.5f && analyzerShowing.get();
+    if (analyzerCapturing)
+    {
+        if (!analyzerWasCapturing)
+            analyzerCapture.restart();
+
+        analyzerCapture.beginWrite(buffer.getNumSamples());
+        captureForAnalyzer(CaptureChannel::PreEQLeft, buffer);
+    }
+
     // Creating context to be passed to the chain       ~A
     juce::dsp::AudioBlock<float> block(buffer);
 
-    auto leftBlock = block.getSingleChannelBlock(0);
-    auto rightBlock = block.getSingleChannelBlock(1);
+    if (morphing)
+    {
+        processMorphing(block, morphChanged);
+    }
+    else
+    {
+        auto leftBlock = block.getSingleChannelBlock(0);
+        auto rightBlock = block.getSingleChannelBlock(1);
+
+        juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
+        juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
 
-    juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
-    juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
+        leftChain.process(leftContext);
+        rightChain.process(rightContext);
+    }
 
-    leftChain.process(leftContext);
-    rightChain.process(rightContext);
+    if (fading)
+        mixSwitchFade(buffer, numSamples);
 
-    // Pushing the buffers into fifo    ~A
-    leftChannelFifo.update(buffer);
-    rightChannelFifo.update(buffer);
+    if (analyzerCapturing)
+    {
+        captureForAnalyzer(CaptureChannel::PostEQLeft, buffer);
+        analyzerCapture.publish();
+    }
+    analyzerWasCapturing = analyzerCapturing;
+}
+
+// A mono bus fills both lanes of a tap with its only channel   ~A
+void EQ_LiteAudioProcessor::captureForAnalyzer(int firstCaptureChannel, const juce::AudioBuffer<float>& buffer)
+{
+    for (int ch = 0; ch < 2; ++ch)
+        analyzerCapture.writeChannel(firstCaptureChannel + ch, buffer.getReadPointer(juce::jmin(ch, buffer.getNumChannels() - 1)));
 }
 
 //==============================================================================
@@ -205,10 +435,26 @@ void EQ_LiteAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
 
-    // Creating state saving functionality  ~A
+    // Creating state saving functionality, a fixed layout of plain values   ~A
     juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    mos.writeInt(binaryStateMagic);
+    mos.writeInt(binaryStateVersion);
 
+    const auto& stateParameterIDs = getStateParameterIDs();
+    mos.writeInt(stateParameterIDs.size());
+
+    for (auto& parameterID : stateParameterIDs)
+        mos.writeFloat(apvts.getRawParameterValue(parameterID)->load());
+
+    // Version 2 on, the morph ends follow, a flag and the preset values for each.
+    // Version 3 on, the number of values comes before them   ~A
+    for (int end = 0; end < numMorphEnds; ++end)
+    {
+        mos.writeBool(morphEndUsed[(size_t)end]);
+        mos.writeInt(numPresetValues);
+        for (auto value : morphEnds[(size_t)end])
+            mos.writeFloat(value);
+    }
 }
 
 void EQ_LiteAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -216,248 +462,910 @@ void EQ_LiteAudioProcessor::setStateInformation (const void* data, int sizeInByt
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
 
-    // Creating state loading functionality     ~A
+    juce::MemoryInputStream mis(data, (size_t)juce::jmax(0, sizeInBytes), false);
+    if (sizeInBytes >= 3 * (int)sizeof(int) && mis.readInt() == binaryStateMagic)
+    {
+        restoreBinaryState(mis);
+        return;
+    }
+
+    // Creating state loading functionality, for sessions saved as a ValueTree    ~A
     auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
     if (tree.isValid())
     {
         apvts.replaceState(tree);
-        updateFilters();
+        parameterGeneration.fetch_add(1, std::memory_order_acq_rel);
     }
 }
 
+// Setting the parameters directly, only the ones that differ. Values a newer layout
+// added are skipped, parameters an older one didn't have go back to their defaults.
+// The filters get designed on the audio thread, see parameterGeneration   ~A
+bool EQ_LiteAudioProcessor::restoreBinaryState(juce::MemoryInputStream& stream)
+{
+    const auto savedVersion = stream.readInt();
+    const auto numSavedValues = stream.readInt();
 
-ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
+    if (savedVersion < 1 || numSavedValues < 0
+        || stream.getNumBytesRemaining() < (juce::int64)numSavedValues * (juce::int64)sizeof(float))
+    {
+        jassertfalse;
+        return false;
+    }
+
+    const auto& stateParameterIDs = getStateParameterIDs();
+    const auto numStateParameters = stateParameterIDs.size();
+
+    for (int index = 0; index < numStateParameters; ++index)
+    {
+        auto* parameter = apvts.getParameter(stateParameterIDs[index]);
+        jassert(parameter != nullptr);
+
+        auto normalisedValue = parameter->getDefaultValue();
+        if (index < numSavedValues)
+            normalisedValue = parameter->convertTo0to1(migrateStateValue(savedVersion, index, stream.readFloat()));
+
+        if (parameter->getValue() != normalisedValue)
+            parameter->setValueNotifyingHost(normalisedValue);
+    }
+
+    if (numSavedValues > numStateParameters)
+        stream.skipNextBytes((juce::int64)(numSavedValues - numStateParameters) * (juce::int64)sizeof(float));
+
+    for (int end = 0; end < numMorphEnds; ++end)
+    {
+        auto& values = morphEnds[(size_t)end];
+        values.fill(std::numeric_limits<float>::quiet_NaN());
+        morphEndUsed[(size_t)end] = false;
+
+        if (savedVersion < 2 || stream.getNumBytesRemaining() < 1)
+            continue;
+
+        const auto used = stream.readBool();
+        const auto numValues = savedVersion >= 3 ? stream.readInt() : numPresetValuesBeforeExtraBands;
+        if (numValues < 0 || stream.getNumBytesRemaining() < (juce::int64)numValues * (juce::int64)sizeof(float))
+            break;
+
+        for (int index = 0; index < numValues; ++index)
+        {
+            const auto value = stream.readFloat();
+            if (index < numPresetValues)
+                values[(size_t)index] = value;
+        }
+
+        morphEndUsed[(size_t)end] = used;
+        values = withDefaultsFilledIn(values);
+    }
+    publishMorphSettings();
+
+    parameterGeneration.fetch_add(1, std::memory_order_acq_rel);
+    return true;
+}
+
+
+// Reading the settings from anything that gives the plain value at a place in the
+// preset table, the parameters themselves or a preset   ~A
+template<typename ValueAt>
+static ChainSettings readChainSettings(ValueAt&& valueAt)
 {
+    const auto& index = getPresetIndices();
     ChainSettings chSettings;
 
-    chSettings.lowCutFreq = apvts.getRawParameterValue("LowCut Freq")->load();
-    chSettings.highCutFreq = apvts.getRawParameterValue("HiCut Freq")->load();
-    chSettings.band1Freq = apvts.getRawParameterValue("Band1 Freq")->load();
-    chSettings.band1GainDB = apvts.getRawParameterValue("Band1 Gain")->load();
-    chSettings.band1Quality = apvts.getRawParameterValue("Band1 Quality")->load();
-    chSettings.band2Freq = apvts.getRawParameterValue("Band2 Freq")->load();
-    chSettings.band2GainDB = apvts.getRawParameterValue("Band2 Gain")->load();
-    chSettings.band2Quality = apvts.getRawParameterValue("Band2 Quality")->load();
-    chSettings.band3Freq = apvts.getRawParameterValue("Band3 Freq")->load();
-    chSettings.band3GainDB = apvts.getRawParameterValue("Band3 Gain")->load();
-    chSettings.band3Quality = apvts.getRawParameterValue("Band3 Quality")->load();
-    chSettings.lowCutSlope = static_cast<Slope>(apvts.getRawParameterValue("LowCut Slope")->load());    // Static casting to slope enum type not to interfere   ~A
-    chSettings.highCutSlope = static_cast<Slope>(apvts.getRawParameterValue("HiCut Slope")->load());
-    chSettings.gainDB = apvts.getRawParameterValue("Output Gain")->load();
-
-    chSettings.lowCutBypassed = apvts.getRawParameterValue("LowCut Bypassed")->load() > 0.5f;
-    chSettings.band1Bypassed = apvts.getRawParameterValue("Band1 Bypassed")->load() > 0.5f;
-    chSettings.band2Bypassed = apvts.getRawParameterValue("Band2 Bypassed")->load() > 0.5f;
-    chSettings.band3Bypassed = apvts.getRawParameterValue("Band3 Bypassed")->load() > 0.5f;
-    chSettings.highCutBypassed = apvts.getRawParameterValue("HighCut Bypassed")->load() > 0.5f;
-    chSettings.allBypassed = apvts.getRawParameterValue("All Bypassed")->load() > 0.5f;
+    chSettings.lowCutFreq = valueAt(index.lowCutFreq);
+    chSettings.highCutFreq = valueAt(index.highCutFreq);
+    chSettings.lowCutSlope = static_cast<Slope>(valueAt(index.lowCutSlope));    // Static casting to slope enum type not to interfere   ~A
+    chSettings.highCutSlope = static_cast<Slope>(valueAt(index.highCutSlope));
+    chSettings.gainDB = valueAt(index.outputGain);
+
+    for (int band = 0; band < maxPeakBands; ++band)
+    {
+        const auto& fields = index.bands[(size_t)band];
+        chSettings.bands.freq[(size_t)band] = valueAt(fields[BandFreq]);
+        chSettings.bands.gainDB[(size_t)band] = valueAt(fields[BandGain]);
+        chSettings.bands.quality[(size_t)band] = valueAt(fields[BandQuality]);
+        chSettings.bands.bypassed[(size_t)band] = valueAt(fields[BandBypassed]) > 0.5f;
+    }
+
+    chSettings.lowCutBypassed = valueAt(index.lowCutBypassed) > 0.5f;
+    chSettings.highCutBypassed = valueAt(index.highCutBypassed) > 0.5f;
+    chSettings.allBypassed = valueAt(index.allBypassed) > 0.5f;
 
 
     return chSettings;
 }
 
+ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
+{
+    const auto& ids = getPresetParameterIDs();
+    return readChainSettings([&apvts, &ids](int index) { return apvts.getRawParameterValue(ids[index])->load(); });
+}
 
-Coefficients makeBand1Filter(const ChainSettings& chainSettings, double sampleRate)
+static ChainSettings getChainSettings(const EQ_LiteAudioProcessor::PresetValues& values)
 {
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate,
-                                                               chainSettings.band1Freq,
-                                                               chainSettings.band1Quality,
-                                                               juce::Decibels::decibelsToGain(chainSettings.band1GainDB));
+    return readChainSettings([&values](int index) { return values[(size_t)index]; });
 }
 
-Coefficients makeBand2Filter(const ChainSettings& chainSettings, double sampleRate)
+
+void updateCoefficients(Coefficients& old, const Coefficients& replacement)
 {
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate,
-                                                               chainSettings.band2Freq,
-                                                               chainSettings.band2Quality,
-                                                               juce::Decibels::decibelsToGain(chainSettings.band2GainDB));
+    *old = *replacement;
 }
 
-Coefficients makeBand3Filter(const ChainSettings& chainSettings, double sampleRate)
+ChainDesign makeChainDesign(const ChainSettings& chainSettings, double sampleRate)
 {
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate,
-                                                               chainSettings.band3Freq,
-                                                               chainSettings.band3Quality,
-                                                               juce::Decibels::decibelsToGain(chainSettings.band3GainDB));
+    ChainDesign design;
+    design.settings = chainSettings;
+
+    const auto& bands = chainSettings.bands;
+    for (int band = 0; band < maxPeakBands; ++band)
+        if (!bands.bypassed[(size_t)band])
+            design.peaks.setPeak(band, sampleRate, bands.freq[(size_t)band], bands.quality[(size_t)band], bands.gainDB[(size_t)band]);
+
+    design.lowCut = makeLowCutFilter(chainSettings, sampleRate);
+    design.highCut = makeHighCutFilter(chainSettings, sampleRate);
+    return design;
 }
 
+// Bypassing everything when the whole plugin is, the output gain included   ~A
+static void setBandBypassStates(MonoChain& chain, const ChainSettings& chainSettings)
+{
+    const auto allBypassed = chainSettings.allBypassed;
+
+    chain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed || allBypassed);
+    chain.setBypassed<ChainPositions::Peaks>(allBypassed);
+    chain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed || allBypassed);
+    chain.setBypassed<ChainPositions::OutputDB>(allBypassed);
+}
+
+void applyChainDesign(MonoChain& chain, const ChainDesign& design)
+{
+    const auto& chainSettings = design.settings;
+    setBandBypassStates(chain, chainSettings);
+
+    std::array<bool, maxPeakBands> active;
+    for (size_t band = 0; band < active.size(); ++band)
+        active[band] = !chainSettings.bands.bypassed[band];
+
+    updateCutFilter(chain.get<ChainPositions::LowCut>(), design.lowCut, chainSettings.lowCutSlope);
+    chain.get<ChainPositions::Peaks>().setCoefficients(design.peaks, active);
+    updateCutFilter(chain.get<ChainPositions::HighCut>(), design.highCut, chainSettings.highCutSlope);
+
+    chain.get<ChainPositions::OutputDB>().setGainDecibels(chainSettings.gainDB);
+}
+
+// A filter starts out with first order coefficients, and changing the order later
+// reallocates its state. Starting every cut stage as a second order pass-through
+// keeps the in-place writers below from ever having to. The peak cascade holds
+// plain arrays, it has nothing to prepare   ~A
+void prepareChainStages(MonoChain& chain)
+{
+    auto makeSecondOrder = [](Filter& filter)
+    {
+        *filter.coefficients = juce::dsp::IIR::Coefficients<float>(1.f, 0.f, 0.f, 1.f, 0.f, 0.f);
+    };
+
+    auto makeCutSecondOrder = [&makeSecondOrder](CutFilter& cut)
+    {
+        makeSecondOrder(cut.get<0>());
+        makeSecondOrder(cut.get<1>());
+        makeSecondOrder(cut.get<2>());
+        makeSecondOrder(cut.get<3>());
+    };
+
+    makeCutSecondOrder(chain.get<ChainPositions::LowCut>());
+    makeCutSecondOrder(chain.get<ChainPositions::HighCut>());
+}
+
+void PeakCoefficients::setPeak(int band, double sampleRate, float frequency, float quality, float gainDB)
+{
+    const auto amplitude = std::pow(10.f, gainDB / 40.f);
+    const auto omega = juce::MathConstants<float>::twoPi * juce::jmax(frequency, 2.f) / (float)sampleRate;
+    const auto alpha = std::sin(omega) / (quality * 2.f);
+    const auto c2 = -2.f * std::cos(omega);
+    const auto a0 = 1.f + alpha / amplitude;
+
+    const auto index = (size_t)band;
+    b0[index] = (1.f + alpha * amplitude) / a0;
+    b1[index] = c2 / a0;
+    b2[index] = (1.f - alpha * amplitude) / a0;
+    a1[index] = c2 / a0;
+    a2[index] = (1.f - alpha / amplitude) / a0;
+}
+
+void PeakCascade::reset()
+{
+    state1.fill(0.f);
+    state2.fill(0.f);
+}
 
-// Code cleaning helper functions declarations      ~A
-void EQ_LiteAudioProcessor::updateBand1Filter(const ChainSettings& chainSettings)
+void PeakCascade::update(const PeakBandSettings& bands, double sampleRate)
 {
-    /*auto band1Coefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter(getSampleRate(),
-                                                                                chainSettings.band1Freq,
-                                                                                chainSettings.band1Quality,
-                                                                                juce::Decibels::decibelsToGain(chainSettings.band1GainDB));*/
-    auto band1Coefficients = makeBand1Filter(chainSettings, getSampleRate());
+    std::array<bool, maxPeakBands> active;
+    for (size_t band = 0; band < active.size(); ++band)
+        active[band] = !bands.bypassed[band];
+
+    setActiveBands(active);
 
-    leftChain.setBypassed<ChainPositions::Band1>(chainSettings.band1Bypassed);
-    rightChain.setBypassed<ChainPositions::Band1>(chainSettings.band1Bypassed);
-    if (chainSettings.allBypassed)
+    for (int index = 0; index < numActiveBands; ++index)
     {
-        leftChain.setBypassed<ChainPositions::Band1>(true);
-        rightChain.setBypassed<ChainPositions::Band1>(true);
+        const auto band = (size_t)activeBands[(size_t)index];
+        coefficients.setPeak((int)band, sampleRate, bands.freq[band], bands.quality[band], bands.gainDB[band]);
     }
+}
+
+void PeakCascade::setCoefficients(const PeakCoefficients& newCoefficients, const std::array<bool, maxPeakBands>& active)
+{
+    coefficients = newCoefficients;
+    setActiveBands(active);
+}
 
-    updateCoefficients(leftChain.get<ChainPositions::Band1>().coefficients, band1Coefficients);
-    updateCoefficients(rightChain.get<ChainPositions::Band1>().coefficients, band1Coefficients);
+void PeakCascade::copyFrom(const PeakCascade& other)
+{
+    setCoefficients(other.coefficients, other.bandActive);
 }
 
-void EQ_LiteAudioProcessor::updateBand2Filter(const ChainSettings& chainSettings)
+void PeakCascade::setActiveBands(const std::array<bool, maxPeakBands>& active)
 {
-   /* auto band2Coefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter(getSampleRate(),
-                                                                                 chainSettings.band2Freq,
-                                                                                 chainSettings.band2Quality,
-                                                                                 juce::Decibels::decibelsToGain(chainSettings.band2GainDB));*/
-    auto band2Coefficients = makeBand2Filter(chainSettings, getSampleRate());
+    numActiveBands = 0;
 
-    leftChain.setBypassed<ChainPositions::Band2>(chainSettings.band2Bypassed);
-    rightChain.setBypassed<ChainPositions::Band2>(chainSettings.band2Bypassed);
-    if (chainSettings.allBypassed)
+    for (size_t band = 0; band < active.size(); ++band)
     {
-       leftChain.setBypassed<ChainPositions::Band2>(true);
-       rightChain.setBypassed<ChainPositions::Band2>(true);
+        if (active[band] && !bandActive[band])
+            state1[band] = state2[band] = 0.f;
+
+        bandActive[band] = active[band];
+        if (active[band])
+            activeBands[(size_t)numActiveBands++] = (int)band;
     }
+}
 
-    updateCoefficients(leftChain.get<ChainPositions::Band2>().coefficients, band2Coefficients);
-    updateCoefficients(rightChain.get<ChainPositions::Band2>().coefficients, band2Coefficients);
+// Transposed direct form II, like IIR::Filter, one band over the whole block at a
+// time so its coefficients and state stay in registers   ~A
+void PeakCascade::processBand(int band, float* samples, size_t numSamples) noexcept
+{
+    const auto index = (size_t)band;
+    const auto b0 = coefficients.b0[index], b1 = coefficients.b1[index], b2 = coefficients.b2[index];
+    const auto a1 = coefficients.a1[index], a2 = coefficients.a2[index];
+    auto s1 = state1[index], s2 = state2[index];
+
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        const auto input = samples[i];
+        const auto output = b0 * input + s1;
+        s1 = b1 * input - a1 * output + s2;
+        s2 = b2 * input - a2 * output;
+        samples[i] = output;
+    }
+
+    state1[index] = s1;
+    state2[index] = s2;
 }
 
-void EQ_LiteAudioProcessor::updateBand3Filter(const ChainSettings& chainSettings)
+// The Butterworth stages of designIIR...HighOrderButterworthMethod() for an even
+// order, the same formulas as IIR::Coefficients::makeHighPass() and makeLowPass()
+// written over the five normalised values a biquad holds. The stages share the
+// frequency, so it's one tan() for the whole cut   ~A
+static void writeCutCoefficients(CutFilter& cut, double sampleRate, float frequency, int slope, bool isHighPass)
+{
+    const auto pi = juce::MathConstants<float>::pi;
+    const auto order = 2 * (slope + 1);
+    const auto warped = std::tan(pi * juce::jlimit(1.f, 0.49f * (float)sampleRate, frequency) / (float)sampleRate);
+    const auto n = isHighPass ? warped : 1.f / warped;
+    const auto nSquared = n * n;
+
+    auto writeStage = [&](Filter& filter, int stage)
+    {
+        jassert(filter.coefficients->coefficients.size() == 5);
+        auto* raw = filter.coefficients->getRawCoefficients();
+
+        const auto invQ = 2.f * std::cos((2.f * (float)stage + 1.f) * pi / (2.f * (float)order));
+        const auto c1 = 1.f / (1.f + invQ * n + nSquared);
+
+        raw[0] = c1;
+        raw[1] = (isHighPass ? -2.f : 2.f) * c1;
+        raw[2] = c1;
+        raw[3] = c1 * 2.f * (isHighPass ? nSquared - 1.f : 1.f - nSquared);
+        raw[4] = c1 * (1.f - invQ * n + nSquared);
+    };
+
+    writeStage(cut.get<0>(), 0);
+    cut.setBypassed<0>(false);
+
+    if (slope >= Slope_24) writeStage(cut.get<1>(), 1);
+    cut.setBypassed<1>(slope < Slope_24);
+
+    if (slope >= Slope_36) writeStage(cut.get<2>(), 2);
+    cut.setBypassed<2>(slope < Slope_36);
+
+    if (slope >= Slope_48) writeStage(cut.get<3>(), 3);
+    cut.setBypassed<3>(slope < Slope_48);
+}
+
+void updateChainInPlace(MonoChain& chain, const ChainSettings& chainSettings, double sampleRate)
+{
+    setBandBypassStates(chain, chainSettings);
+
+    writeCutCoefficients(chain.get<ChainPositions::LowCut>(), sampleRate, chainSettings.lowCutFreq, chainSettings.lowCutSlope, true);
+    chain.get<ChainPositions::Peaks>().update(chainSettings.bands, sampleRate);
+    writeCutCoefficients(chain.get<ChainPositions::HighCut>(), sampleRate, chainSettings.highCutFreq, chainSettings.highCutSlope, false);
+
+    chain.get<ChainPositions::OutputDB>().setGainDecibels(chainSettings.gainDB);
+}
+
+// Both channels run the same coefficients, designing once and copying is enough   ~A
+void copyChainInPlace(MonoChain& destination, const MonoChain& source)
+{
+    auto copyFilter = [](Filter& to, const Filter& from)
+    {
+        const auto& values = from.coefficients->coefficients;
+        jassert(to.coefficients->coefficients.size() == values.size());
+        std::copy(values.begin(), values.end(), to.coefficients->getRawCoefficients());
+    };
+
+    auto copyCut = [&copyFilter](CutFilter& to, const CutFilter& from)
+    {
+        copyFilter(to.get<0>(), from.get<0>());
+        copyFilter(to.get<1>(), from.get<1>());
+        copyFilter(to.get<2>(), from.get<2>());
+        copyFilter(to.get<3>(), from.get<3>());
+
+        to.setBypassed<0>(from.isBypassed<0>());
+        to.setBypassed<1>(from.isBypassed<1>());
+        to.setBypassed<2>(from.isBypassed<2>());
+        to.setBypassed<3>(from.isBypassed<3>());
+    };
+
+    copyCut(destination.get<ChainPositions::LowCut>(), source.get<ChainPositions::LowCut>());
+    destination.get<ChainPositions::Peaks>().copyFrom(source.get<ChainPositions::Peaks>());
+    copyCut(destination.get<ChainPositions::HighCut>(), source.get<ChainPositions::HighCut>());
+
+    destination.setBypassed<ChainPositions::LowCut>(source.isBypassed<ChainPositions::LowCut>());
+    destination.setBypassed<ChainPositions::Peaks>(source.isBypassed<ChainPositions::Peaks>());
+    destination.setBypassed<ChainPositions::HighCut>(source.isBypassed<ChainPositions::HighCut>());
+    destination.setBypassed<ChainPositions::OutputDB>(source.isBypassed<ChainPositions::OutputDB>());
+
+    destination.get<ChainPositions::OutputDB>().setGainDecibels(source.get<ChainPositions::OutputDB>().getGainDecibels());
+}
+
+// The ends of the frequency range in createParameterLayout(), where a bypassed
+// cut moves to while morphing   ~A
+static constexpr float morphLowestFreq = 20.f, morphHighestFreq = 20000.f;
+
+MorphSettings::MorphSettings(const ChainSettings& from, const ChainSettings& to) : valid(true)
 {
-   /* auto band3Coefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter(getSampleRate(),
-                                                                                 chainSettings.band3Freq,
-                                                                                 chainSettings.band3Quality,
-                                                                                 juce::Decibels::decibelsToGain(chainSettings.band3GainDB));*/
-    auto band3Coefficients = makeBand3Filter(chainSettings, getSampleRate());
+    lowCutBypassed = from.lowCutBypassed && to.lowCutBypassed;
+    highCutBypassed = from.highCutBypassed && to.highCutBypassed;
+    for (size_t band = 0; band < bandBypassed.size(); ++band)
+        bandBypassed[band] = from.bands.bypassed[band] && to.bands.bypassed[band];
 
-    leftChain.setBypassed<ChainPositions::Band3>(chainSettings.band3Bypassed);
-    rightChain.setBypassed<ChainPositions::Band3>(chainSettings.band3Bypassed);
-    if (chainSettings.allBypassed)
+    const std::array<const ChainSettings*, 2> settings{ &from, &to };
+    for (size_t index = 0; index < ends.size(); ++index)
     {
-        leftChain.setBypassed<ChainPositions::Band3>(true);
-        rightChain.setBypassed<ChainPositions::Band3>(true);
+        const auto& own = *settings[index];
+        const auto& other = *settings[1 - index];
+        auto& end = ends[index];
+
+        end.settings = own;
+        for (size_t band = 0; band < (size_t)maxPeakBands; ++band)
+        {
+            end.logBandFreq[band] = std::log(own.bands.freq[band]);
+            end.logBandQuality[band] = std::log(own.bands.quality[band]);
+            end.bandGainDB[band] = own.bands.bypassed[band] ? 0.f : own.bands.gainDB[band];
+        }
+
+        end.logLowCutFreq = std::log(own.lowCutBypassed ? morphLowestFreq : own.lowCutFreq);
+        end.logHighCutFreq = std::log(own.highCutBypassed ? morphHighestFreq : own.highCutFreq);
+
+        if (own.lowCutBypassed)
+            end.settings.lowCutSlope = other.lowCutSlope;
+        if (own.highCutBypassed)
+            end.settings.highCutSlope = other.highCutSlope;
     }
+}
+
+ChainSettings MorphSettings::at(float position) const
+{
+    jassert(valid);
+    position = juce::jlimit(0.f, 1.f, position);
+
+    const auto& from = ends[0];
+    const auto& to = ends[1];
+    auto chainSettings = (position < 0.5f ? from : to).settings;
+
+    auto blend = [position](float a, float b) { return a + (b - a) * position; };
+    auto blendLog = [&blend](float a, float b) { return std::exp(blend(a, b)); };
+
+    // Bands off at both ends stay off and cost nothing here either   ~A
+    auto& bands = chainSettings.bands;
+    for (size_t band = 0; band < (size_t)maxPeakBands; ++band)
+    {
+        bands.bypassed[band] = bandBypassed[band];
+        if (bandBypassed[band])
+            continue;
+
+        bands.freq[band] = blendLog(from.logBandFreq[band], to.logBandFreq[band]);
+        bands.quality[band] = blendLog(from.logBandQuality[band], to.logBandQuality[band]);
+        bands.gainDB[band] = blend(from.bandGainDB[band], to.bandGainDB[band]);
+    }
+
+    chainSettings.lowCutFreq = blendLog(from.logLowCutFreq, to.logLowCutFreq);
+    chainSettings.highCutFreq = blendLog(from.logHighCutFreq, to.logHighCutFreq);
+    chainSettings.gainDB = blend(from.settings.gainDB, to.settings.gainDB);
 
-    updateCoefficients(leftChain.get<ChainPositions::Band3>().coefficients, band3Coefficients);
-    updateCoefficients(rightChain.get<ChainPositions::Band3>().coefficients, band3Coefficients);
+    chainSettings.lowCutBypassed = lowCutBypassed;
+    chainSettings.highCutBypassed = highCutBypassed;
+
+    return chainSettings;
+}
+
+void EQ_LiteAudioProcessor::updateFilters()
+{
+    auto chainSettings = readChainSettings([this](int index) { return eqParameters[(size_t)index]->load(); });
+    auto design = makeChainDesign(chainSettings, getSampleRate());
+    applyChainDesign(leftChain, design);
+    applyChainDesign(rightChain, design);
+
+    publishCoefficients(design.settings);
+}
+
+void BandSections::add(const Filter& filter)
+{
+    // Order N coefficients are stored as b0..bN, a1..aN, already divided by a0   ~A
+    const auto& raw = filter.coefficients->coefficients;
+    const auto order = (raw.size() - 1) / 2;
+    jassert(order >= 1 && order <= 2 && numSections < (int)coefficients.size());
+
+    auto& section = coefficients[(size_t)numSections++];
+    section.fill(0.0);
+
+    for (int i = 0; i <= order; ++i)
+        section[(size_t)i] = raw[i];
+    for (int i = 1; i <= order; ++i)
+        section[(size_t)(2 + i)] = raw[order + i];
 }
 
-void EQ_LiteAudioProcessor::updateOutputGain(const ChainSettings& chainSettings)
+void BandSections::add(const PeakCoefficients& peaks, int band)
 {
-    leftChain.setBypassed<ChainPositions::OutputDB>(false);
-    rightChain.setBypassed<ChainPositions::OutputDB>(false);
-    if (chainSettings.allBypassed)
+    jassert(numSections < (int)coefficients.size());
+
+    const auto index = (size_t)band;
+    coefficients[(size_t)numSections++] = { peaks.b0[index], peaks.b1[index], peaks.b2[index],
+                                            peaks.a1[index], peaks.a2[index] };
+}
+
+// Taking the coefficients straight from the left chain, so the editor draws exactly
+// what runs. The cuts' bypass flags come from the settings, the chain itself has
+// every band bypassed while the whole plugin is. The peak cascade keeps its bands
+// on then, so it can tell by itself   ~A
+void EQ_LiteAudioProcessor::publishCoefficients(const ChainSettings& chainSettings)
+{
+    auto& snapshot = coefficientSnapshots.getWriteBuffer();
+
+    auto collectCut = [](const CutFilter& cut, bool bypassed)
     {
-        leftChain.setBypassed<ChainPositions::OutputDB>(true);
-        rightChain.setBypassed<ChainPositions::OutputDB>(true);
+        BandSections sections;
+        if (!bypassed)
+        {
+            if (!cut.isBypassed<0>()) sections.add(cut.get<0>());
+            if (!cut.isBypassed<1>()) sections.add(cut.get<1>());
+            if (!cut.isBypassed<2>()) sections.add(cut.get<2>());
+            if (!cut.isBypassed<3>()) sections.add(cut.get<3>());
+        }
+        return sections;
+    };
+
+    snapshot.bands[CoefficientSnapshot::lowCutBand] = collectCut(leftChain.get<ChainPositions::LowCut>(), chainSettings.lowCutBypassed);
+    snapshot.bands[CoefficientSnapshot::highCutBand] = collectCut(leftChain.get<ChainPositions::HighCut>(), chainSettings.highCutBypassed);
+
+    const auto& peaks = leftChain.get<ChainPositions::Peaks>();
+    for (int band = 0; band < maxPeakBands; ++band)
+    {
+        auto& sections = snapshot.bands[(size_t)CoefficientSnapshot::getPeakBand(band)];
+        sections = {};
+        if (peaks.isBandActive(band))
+            sections.add(peaks.getCoefficients(), band);
     }
 
-    leftChain.get<ChainPositions::OutputDB>().setGainDecibels(chainSettings.gainDB);
-    rightChain.get<ChainPositions::OutputDB>().setGainDecibels(chainSettings.gainDB);
+    snapshot.sampleRate = getSampleRate();
+    snapshot.allBypassed = chainSettings.allBypassed;
+
+    if (snapshot.hasSameResponse(lastPublishedCoefficients))
+        return;
+
+    snapshot.version = lastPublishedCoefficients.version + 1;
+    lastPublishedCoefficients = snapshot;
+    coefficientSnapshots.publish();
 }
 
-void updateCoefficients(Coefficients& old, const Coefficients& replacement)
+// The running chains become the outgoing ones, state and all, so the old sound
+// carries on without a break. The new coefficients start from silence in the main
+// chains, which the fade in hides. The switch stands in for updateFilters(), so
+// it publishes them for the editor too   ~A
+void EQ_LiteAudioProcessor::startSwitchFade(const ChainDesign& design)
 {
-    *old = *replacement;
+    using std::swap;
+    swap(leftChain, outgoingLeftChain);
+    swap(rightChain, outgoingRightChain);
+
+    leftChain.reset();
+    rightChain.reset();
+    applyChainDesign(leftChain, design);
+    applyChainDesign(rightChain, design);
+
+    publishCoefficients(design.settings);
+
+    switchFadePosition = 0;
+}
+
+// Equal power, so the level holds up halfway through even when the two differ   ~A
+void EQ_LiteAudioProcessor::mixSwitchFade(juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    juce::dsp::AudioBlock<float> outgoingBlock(outgoingBuffer);
+    auto leftBlock = outgoingBlock.getSingleChannelBlock(0).getSubBlock(0, (size_t)numSamples);
+    auto rightBlock = outgoingBlock.getSingleChannelBlock(1).getSubBlock(0, (size_t)numSamples);
+
+    juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
+    juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
+
+    outgoingLeftChain.process(leftContext);
+    outgoingRightChain.process(rightContext);
+
+    const auto numChannels = juce::jmin(2, buffer.getNumChannels());
+    const auto halfPi = juce::MathConstants<float>::halfPi;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto progress = juce::jmin(1.f, (float)(switchFadePosition + i) / (float)switchFadeLength);
+        const auto fadeIn = std::sin(progress * halfPi);
+        const auto fadeOut = std::cos(progress * halfPi);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto* samples = buffer.getWritePointer(ch);
+            samples[i] = samples[i] * fadeIn + outgoingBuffer.getSample(ch, i) * fadeOut;
+        }
+    }
+
+    switchFadePosition = juce::jmin(switchFadeLength, switchFadePosition + numSamples);
 }
 
-void EQ_LiteAudioProcessor::updateLowCutFilters(const ChainSettings& chainSettings)
+void EQ_LiteAudioProcessor::loadPreset(int index)
 {
-    // Low cut filter parameters
+    PresetValues values;
+    presetBank->getValues(index, values.data(), numPresetValues);
+    switchToValues(values);
+}
 
-    auto LcutCoefficients = makeLowCutFilter(chainSettings, getSampleRate());
-    auto& leftLowCut = leftChain.get<ChainPositions::LowCut>();
-    auto& rightLowCut = rightChain.get<ChainPositions::LowCut>();
+bool EQ_LiteAudioProcessor::savePreset(const juce::String& name)
+{
+    auto values = getCurrentValues();
+    return presetBank->addPreset(name, values.data(), numPresetValues);
+}
 
-    leftChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed);
-    rightChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypassed);
-    if (chainSettings.allBypassed)
+void EQ_LiteAudioProcessor::selectComparisonSlot(int slot)
+{
+    jassert(juce::isPositiveAndBelow(slot, numComparisonSlots));
+    if (slot == activeComparisonSlot)
+        return;
+
+    comparisonSlots[(size_t)activeComparisonSlot] = getCurrentValues();
+    comparisonSlotUsed[(size_t)activeComparisonSlot] = true;
+    activeComparisonSlot = slot;
+
+    if (comparisonSlotUsed[(size_t)slot])
+        switchToValues(comparisonSlots[(size_t)slot]);
+}
+
+EQ_LiteAudioProcessor::PresetValues EQ_LiteAudioProcessor::getCurrentValues() const
+{
+    PresetValues values;
+    for (int index = 0; index < numPresetValues; ++index)
+        values[(size_t)index] = eqParameters[(size_t)index]->load();
+    return values;
+}
+
+EQ_LiteAudioProcessor::PresetValues EQ_LiteAudioProcessor::withDefaultsFilledIn(const PresetValues& values) const
+{
+    const auto& presetIDs = getPresetParameterIDs();
+    PresetValues plainValues;
+
+    for (int index = 0; index < numPresetValues; ++index)
     {
-        leftChain.setBypassed<ChainPositions::LowCut>(true);
-        rightChain.setBypassed<ChainPositions::LowCut>(true);
+        auto* parameter = apvts.getParameter(presetIDs[index]);
+        plainValues[(size_t)index] = std::isnan(values[(size_t)index])
+                                         ? parameter->convertFrom0to1(parameter->getDefaultValue())
+                                         : values[(size_t)index];
     }
 
-    updateCutFilter(leftLowCut, LcutCoefficients, chainSettings.lowCutSlope);
-    updateCutFilter(rightLowCut, LcutCoefficients, chainSettings.lowCutSlope);
+    return plainValues;
 }
 
-void EQ_LiteAudioProcessor::updateHighCutFilters(const ChainSettings& chainSettings)
+// The parameters get set first, with the audio thread holding off, then the switch
+// is designed from what they ended up as. It's tagged with the generation read
+// before that, so a change coming in meanwhile still gets its own update   ~A
+void EQ_LiteAudioProcessor::switchToValues(const PresetValues& values)
 {
-    // High cut (low pass)
-    auto HcutCoefficients = makeHighCutFilter(chainSettings, getSampleRate());
-    // Repeating the process for both channels      ~A
-    auto& leftHighCut = leftChain.get<ChainPositions::HighCut>();
-    auto& rightHighCut = rightChain.get<ChainPositions::HighCut>();
+    const auto plainValues = withDefaultsFilledIn(values);
+
+    // While morphing the parameters don't reach the filters, nothing to fade to   ~A
+    const auto fades = getSampleRate() > 0 && !isMorphEngaged();
+    if (fades)
+        switchingParameters.store(true, std::memory_order_release);
 
-    leftChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed);
-    rightChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypassed);
-    if (chainSettings.allBypassed)
+    const auto& presetIDs = getPresetParameterIDs();
+    for (int index = 0; index < numPresetValues; ++index)
     {
-        leftChain.setBypassed<ChainPositions::HighCut>(true);
-        rightChain.setBypassed<ChainPositions::HighCut>(true);
+        auto* parameter = apvts.getParameter(presetIDs[index]);
+        auto normalisedValue = parameter->convertTo0to1(plainValues[(size_t)index]);
+
+        if (parameter->getValue() != normalisedValue)
+            parameter->setValueNotifyingHost(normalisedValue);
     }
 
-    updateCutFilter(leftHighCut, HcutCoefficients, chainSettings.highCutSlope);
-    updateCutFilter(rightHighCut, HcutCoefficients, chainSettings.highCutSlope);
+    if (fades)
+    {
+        auto& pendingSwitch = pendingSwitches.getWriteBuffer();
+        pendingSwitch.parameterGeneration = parameterGeneration.load(std::memory_order_acquire);
+        pendingSwitch.design = makeChainDesign(readChainSettings([this](int index) { return eqParameters[(size_t)index]->load(); }),
+                                               getSampleRate());
+        pendingSwitches.publish();
+
+        switchingParameters.store(false, std::memory_order_release);
+    }
 }
 
-void EQ_LiteAudioProcessor::updateFilters()
+void EQ_LiteAudioProcessor::captureMorphEnd(int end)
 {
-    auto chainSettings = getChainSettings(apvts);
-    updateLowCutFilters(chainSettings);
-    updateBand1Filter(chainSettings);
-    updateBand2Filter(chainSettings);
-    updateBand3Filter(chainSettings);
-    updateHighCutFilters(chainSettings);
-    updateOutputGain(chainSettings);
+    jassert(juce::isPositiveAndBelow(end, numMorphEnds));
+    morphEnds[(size_t)end] = getCurrentValues();
+    morphEndUsed[(size_t)end] = true;
+    publishMorphSettings();
 }
 
+bool EQ_LiteAudioProcessor::isMorphEngaged() const
+{
+    return morphEnabled->load() > 0.5f && morphEndUsed[0] && morphEndUsed[1];
+}
 
-    // Adding audio processor parameters here. Low cut and high cut with steepness choice, 3 bands with Q and dB parameters    ~A
-juce::AudioProcessorValueTreeState::ParameterLayout
-EQ_LiteAudioProcessor::createParameterLayout()
+// Working the ends out once here, the audio thread only ever blends them   ~A
+void EQ_LiteAudioProcessor::publishMorphSettings()
 {
-    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+    auto& settings = morphSettings.getWriteBuffer();
+    settings = morphEndUsed[0] && morphEndUsed[1]
+                   ? MorphSettings(getChainSettings(morphEnds[0]), getChainSettings(morphEnds[1]))
+                   : MorphSettings();
+    morphSettings.publish();
+}
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("LowCut Freq", "LowCut Freq",
-        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 20.f));  // Setting skew factor to 0.25 for more natural frequence scrolling     ~A
+// Hosts hand the position over once per block at best, so it ramps across the
+// block from where the last one ended. Each sub-block gets the position at its
+// end, and the coefficients only get written when that moved   ~A
+void EQ_LiteAudioProcessor::processMorphing(juce::dsp::AudioBlock<float>& block, bool morphChanged)
+{
+    const auto& morph = morphSettings.getReadBuffer();
+    const auto targetPosition = morphPosition->load();
+    const auto numSamples = (int)block.getNumSamples();
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("HiCut Freq", "HiCut Freq",
-        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 20000.f));
+    // Nothing to ramp from when the morph just started or the ends changed   ~A
+    if (morphChanged)
+        lastMorphPosition = targetPosition;
 
+    ChainSettings chainSettings;
+    auto designed = false;
 
+    for (int start = 0; start < numSamples; start += morphSubBlockSize)
+    {
+        const auto length = juce::jmin(morphSubBlockSize, numSamples - start);
+        const auto position = lastMorphPosition
+                            + (targetPosition - lastMorphPosition) * (float)(start + length) / (float)numSamples;
+
+        if (morphChanged || position != appliedMorphPosition)
+        {
+            chainSettings = morph.at(position);
+            updateChainInPlace(leftChain, chainSettings, getSampleRate());
+            copyChainInPlace(rightChain, leftChain);
+
+            appliedMorphPosition = position;
+            morphChanged = false;
+            designed = true;
+        }
+
+        auto subBlock = block.getSubBlock((size_t)start, (size_t)length);
+        auto leftBlock = subBlock.getSingleChannelBlock(0);
+        auto rightBlock = subBlock.getSingleChannelBlock(1);
+
+        juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
+        juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
+
+        leftChain.process(leftContext);
+        rightChain.process(rightContext);
+    }
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band1 Freq", "Band1 Freq",
-        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 400.f));
+    lastMorphPosition = targetPosition;
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band1 Gain", "Band1 Gain",
-        juce::NormalisableRange<float>(-24.f, 24.f, 0.1f, 1.f), 0.f));
+    if (designed)
+        publishCoefficients(chainSettings);
+}
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band1 Quality", "Band1 Quality",
-        juce::NormalisableRange<float>(0.1f, 10.f, 0.05f, 1.f), 1.f));
+PresetBank::PresetBank() : file(getDefaultFile())
+{
+    map();
+}
 
+juce::File PresetBank::getDefaultFile()
+{
+    return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+        .getChildFile("EQ_Lite")
+        .getChildFile("Presets.eqbank");
+}
 
+juce::int32 PresetBank::readInt(size_t offset) const
+{
+    return (juce::int32)juce::ByteOrder::littleEndianInt(data + offset);
+}
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band2 Freq", "Band2 Freq",
-        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 1000.f));
+// A file that's missing, damaged or from a newer layout we can't read leaves the
+// bank empty rather than half read   ~A
+void PresetBank::map()
+{
+    mappedFile.reset();
+    data = nullptr;
+    dataSize = 0;
+    numPresets = valuesPerPreset = 0;
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band2 Gain", "Band2 Gain",
-        juce::NormalisableRange<float>(-24.f, 24.f, 0.1f, 1.f), 0.f));
+    if (!file.existsAsFile())
+        return;
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band2 Quality", "Band2 Quality",
-        juce::NormalisableRange<float>(0.1f, 10.f, 0.05f, 1.f), 1.f));
+    mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    data = static_cast<const char*>(mappedFile->getData());
+    dataSize = mappedFile->getSize();
+
+    if (data == nullptr || dataSize < (size_t)headerSize || readInt(0) != magic || readInt(4) != version)
+    {
+        mappedFile.reset();
+        data = nullptr;
+        dataSize = 0;
+        return;
+    }
+
+    const auto count = readInt(8);
+    const auto stride = readInt(12);
+    valuesOffset = (size_t)headerSize + 2 * sizeof(juce::int32) * (size_t)juce::jmax(0, count);
+    namesOffset = valuesOffset + sizeof(float) * (size_t)juce::jmax(0, count) * (size_t)juce::jmax(0, stride);
+
+    if (count < 0 || stride < 0 || namesOffset > dataSize)
+        return;
+
+    numPresets = count;
+    valuesPerPreset = stride;
+}
+
+juce::String PresetBank::getName(int index) const
+{
+    if (!juce::isPositiveAndBelow(index, numPresets))
+        return {};
+
+    const auto entry = (size_t)headerSize + 2 * sizeof(juce::int32) * (size_t)index;
+    const auto offset = (size_t)juce::jmax(0, readInt(entry));
+    const auto length = (size_t)juce::jmax(0, readInt(entry + sizeof(juce::int32)));
+
+    if (namesOffset + offset + length > dataSize)
+        return {};
+
+    return juce::String::fromUTF8(data + namesOffset + offset, (int)length);
+}
+
+void PresetBank::getValues(int index, float* values, int numValues) const
+{
+    for (int i = 0; i < numValues; ++i)
+        values[i] = std::numeric_limits<float>::quiet_NaN();
+
+    if (!juce::isPositiveAndBelow(index, numPresets))
+        return;
+
+    const auto* source = data + valuesOffset + sizeof(float) * (size_t)index * (size_t)valuesPerPreset;
+    for (int i = 0; i < juce::jmin(numValues, valuesPerPreset); ++i)
+    {
+        auto bits = juce::ByteOrder::littleEndianInt(source + sizeof(float) * (size_t)i);
+        std::memcpy(values + i, &bits, sizeof(float));
+    }
+}
+
+bool PresetBank::addPreset(const juce::String& name, const float* values, int numValues)
+{
+    const auto newCount = numPresets + 1;
+    const auto newStride = juce::jmax(valuesPerPreset, numValues);
+
+    juce::MemoryOutputStream header, names;
+    juce::MemoryOutputStream presetValues;
 
+    header.writeInt(magic);
+    header.writeInt(version);
+    header.writeInt(newCount);
+    header.writeInt(newStride);
 
+    std::vector<float> presetData((size_t)newStride);
+    for (int index = 0; index < newCount; ++index)
+    {
+        const auto isNew = index == numPresets;
+        const auto presetName = isNew ? name : getName(index);
+
+        if (isNew)
+        {
+            std::fill(presetData.begin(), presetData.end(), std::numeric_limits<float>::quiet_NaN());
+            std::copy(values, values + numValues, presetData.begin());
+        }
+        else
+        {
+            getValues(index, presetData.data(), newStride);
+        }
+
+        const auto nameBytes = presetName.toUTF8();
+        const auto nameLength = (int)nameBytes.sizeInBytes() - 1;
+        header.writeInt((int)names.getDataSize());
+        header.writeInt(nameLength);
+        names.write(nameBytes.getAddress(), (size_t)nameLength);
+
+        for (auto value : presetData)
+            presetValues.writeFloat(value);
+    }
+
+    // The old mapping has to go before the file can be replaced   ~A
+    mappedFile.reset();
+    data = nullptr;
+
+    file.getParentDirectory().createDirectory();
+    juce::TemporaryFile temporary(file);
+    bool written = false;
+    {
+        juce::FileOutputStream stream(temporary.getFile());
+        written = stream.openedOk()
+               && stream.write(header.getData(), header.getDataSize())
+               && stream.write(presetValues.getData(), presetValues.getDataSize())
+               && stream.write(names.getData(), names.getDataSize());
+    }
+
+    written = written && temporary.overwriteTargetFileWithTemporary();
+    map();
+    return written;
+}
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band3 Freq", "Band3 Freq",
-        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 5000.f));
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band3 Gain", "Band3 Gain",
+// Frequency, gain and Q of one peak band. The first three keep the defaults they
+// always had, the others spread out evenly over the range    ~A
+static void addBandParameters(juce::AudioProcessorValueTreeState::ParameterLayout& layout, int band)
+{
+    static constexpr float editorBandFreqs[numEditorBands] = { 400.f, 1000.f, 5000.f };
+    const auto defaultFreq = band < numEditorBands
+                                 ? editorBandFreqs[band]
+                                 : std::round(juce::mapToLog10((band + 0.5f) / (float)maxPeakBands, 20.f, 20000.f));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, BandFreq), getBandParameterID(band, BandFreq),
+        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), defaultFreq));
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, BandGain), getBandParameterID(band, BandGain),
         juce::NormalisableRange<float>(-24.f, 24.f, 0.1f, 1.f), 0.f));
 
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Band3 Quality", "Band3 Quality",
+    layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, BandQuality), getBandParameterID(band, BandQuality),
         juce::NormalisableRange<float>(0.1f, 10.f, 0.05f, 1.f), 1.f));
+}
+
+    // Adding audio processor parameters here. Low cut and high cut with steepness choice, peak bands with Q and dB parameters    ~A
+juce::AudioProcessorValueTreeState::ParameterLayout
+EQ_LiteAudioProcessor::createParameterLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>("LowCut Freq", "LowCut Freq",
+        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 20.f));  // Setting skew factor to 0.25 for more natural frequence scrolling     ~A
+
+    layout.add(std::make_unique<juce::AudioParameterFloat>("HiCut Freq", "HiCut Freq",
+        juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.3f), 20000.f));
+
+
+
+    for (int band = 0; band < numEditorBands; ++band)
+        addBandParameters(layout, band);
 
 
     juce::StringArray slopeChoices{"12 dB/Oct", "24 dB/Oct", "36 dB/Oct", "48 dB/Oct"};
@@ -473,14 +1381,52 @@ EQ_LiteAudioProcessor::createParameterLayout()
 
     // Adding bypass buttons parameters     ~A
     layout.add(std::make_unique<juce::AudioParameterBool>("LowCut Bypassed", "LowCut Bypassed", false));
-    layout.add(std::make_unique<juce::AudioParameterBool>("Band1 Bypassed", "Band1 Bypassed", false));
-    layout.add(std::make_unique<juce::AudioParameterBool>("Band2 Bypassed", "Band2 Bypassed", false));
-    layout.add(std::make_unique<juce::AudioParameterBool>("Band3 Bypassed", "Band3 Bypassed", false));
+    for (int band = 0; band < numEditorBands; ++band)
+        layout.add(std::make_unique<juce::AudioParameterBool>(getBandParameterID(band, BandBypassed),
+                                                              getBandParameterID(band, BandBypassed), false));
     layout.add(std::make_unique<juce::AudioParameterBool>("HighCut Bypassed", "HighCut Bypassed", false));
     layout.add(std::make_unique<juce::AudioParameterBool>("All Bypassed", "All Bypassed", false));
 
     layout.add(std::make_unique<juce::AudioParameterBool>("Analyzer Enabled", "Analyzer Enabled", true));
 
+    juce::StringArray overlapChoices{ "50%", "75%", "87.5%" };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer Overlap", "Analyzer Overlap",
+        overlapChoices, AnalyzerOverlap::Overlap_75));
+
+    juce::StringArray resolutionChoices{ "2048", "4096", "8192" };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer Resolution", "Analyzer Resolution",
+        resolutionChoices, 0));
+
+    juce::StringArray smoothingChoices{ "Off", "1/12 Oct", "1/6 Oct", "1/3 Oct" };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer Smoothing", "Analyzer Smoothing",
+        smoothingChoices, AnalyzerSmoothing::Smoothing_Off));
+
+    juce::StringArray averagingChoices{ "Off", "Fast", "Medium", "Slow" };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer Averaging", "Analyzer Averaging",
+        averagingChoices, AnalyzerAveraging::Averaging_Off));
+
+    layout.add(std::make_unique<juce::AudioParameterBool>("Analyzer Peak Hold", "Analyzer Peak Hold", false));
+
+    juce::StringArray modeChoices{ "Left/Right", "Mid/Side", "Sum" };
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer Mode", "Analyzer Mode",
+        modeChoices, AnalyzerMode::Mode_LeftRight));
+
+    layout.add(std::make_unique<juce::AudioParameterBool>("Analyzer Pre EQ", "Analyzer Pre EQ", false));
+
+    // Morphing between the two captured ends, see MorphSettings    ~A
+    layout.add(std::make_unique<juce::AudioParameterBool>("Morph Enabled", "Morph Enabled", false));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("Morph Position", "Morph Position",
+        juce::NormalisableRange<float>(0.f, 1.f), 0.f));
+
+    // The extra peak bands go last, so hosts find every older parameter where it
+    // always was. They start switched off    ~A
+    for (int band = numEditorBands; band < maxPeakBands; ++band)
+    {
+        addBandParameters(layout, band);
+        layout.add(std::make_unique<juce::AudioParameterBool>(getBandParameterID(band, BandBypassed),
+                                                              getBandParameterID(band, BandBypassed), true));
+    }
+
     return layout;
 }
 
@@ -11,53 +11,51 @@
 #include <JuceHeader.h>
 #include <array>
 
-// A fifo the GUI thread will use to retrieve the blocks the single channel fifo produced   ~A
-template<typename T>
+// A single producer / single consumer queue the analyzer uses to hand FFT data
+// and paths to the GUI. Items are swapped in and out of preallocated slots
+// instead of copied, so once the slots are prepared nothing allocates in
+// push or pull - the caller simply gets a recycled slot back   ~A
+template<typename T, int Capacity = 30>
 struct Fifo
 {
-    void prepare(int numChannels, int numSamples)
+    // Setting every slot up in place, e.g. sizing vectors or reserving path space  ~A
+    template<typename SlotInitialiser>
+    void prepareSlots(SlotInitialiser&& initialiseSlot)
     {
-        static_assert(std::is_same_v<T, juce::AudioBuffer<float>>,
-            "prepare(numChannels, numSamples) should only be used when fifo is holding juce::AudioBuffer<float>");
-        for (auto& buffer : buffers)
-        {
-            buffer.setSize(numChannels,
-                           numSamples,
-                           false,       // clear everything?
-                           true,        // including the extra space?
-                           true);       // avoiding reallocating if you can?
-            buffer.clear();
-        }
+        for (auto& slot : slots)
+            initialiseSlot(slot);
+
+        fifo.reset();
     }
 
     void prepare(size_t numElements)
     {
         static_assert(std::is_same_v<T, std::vector<float>>,
             "prepare(numElements) should only be used when fifo is holding std::vector<float>");
-        for (auto buffer : buffers)
-        {
-            buffer.clear();
-            buffer.resize(numElements, 0);
-        }
+        prepareSlots([numElements](std::vector<float>& slot) { slot.assign(numElements, 0.f); });
     }
 
-    bool push(const T& t)
+    // Hands 't' over to the consumer, 't' comes back holding the storage of a free slot  ~A
+    bool push(T& t)
     {
         auto write = fifo.write(1);
         if (write.blockSize1 > 0)
         {
-            buffers[write.startIndex1] = t;
+            using std::swap;
+            swap(slots[(size_t)write.startIndex1], t);
             return true;
         }
         return false;
     }
 
+    // Takes the oldest item, the slot keeps whatever 't' held before   ~A
     bool pull(T& t)
     {
         auto read = fifo.read(1);
         if (read.blockSize1 > 0)
         {
-            t = buffers[read.startIndex1];
+            using std::swap;
+            swap(slots[(size_t)read.startIndex1], t);
             return true;
         }
         return false;
@@ -68,11 +66,47 @@ struct Fifo
         return fifo.getNumReady();
     }
 private:
-    static constexpr int Capacity = 30;
-    std::array<T, Capacity> buffers;
+    std::array<T, Capacity> slots;
     juce::AbstractFifo fifo{ Capacity };
 };
 
+// A lock-free triple buffer for one writer and one reader that only ever need the
+// newest value. The writer fills its own buffer and swaps it in as the newest, the
+// reader swaps the newest out for its own. Neither side waits and neither ever
+// sees a half written value, the writer just overwrites what nobody picked up yet   ~A
+template<typename T>
+struct TripleBuffer
+{
+    // Writer side   ~A
+    T& getWriteBuffer() { return buffers[(size_t)writeIndex]; }
+
+    void publish()
+    {
+        auto previous = middle.exchange(writeIndex | newDataBit, std::memory_order_acq_rel);
+        writeIndex = previous & indexMask;
+    }
+
+    // Reader side. Returns true if something new came in since the last pull,
+    // getReadBuffer() keeps the newest value either way   ~A
+    bool pull()
+    {
+        if ((middle.load(std::memory_order_relaxed) & newDataBit) == 0)
+            return false;
+
+        auto previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & indexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const { return buffers[(size_t)readIndex]; }
+private:
+    static constexpr int indexMask = 3, newDataBit = 4;
+
+    std::array<T, 3> buffers;
+    int writeIndex = 0, readIndex = 1;
+    std::atomic<int> middle{ 2 };
+};
+
 // Declaring enum for R and L channels  ~A
 enum Channel
 {
@@ -81,72 +115,167 @@ enum Channel
 
 };
 
-// The FFT algorithm requires a fixed number of samples. The host is passing
-// in buffers that vary in sample sizes. Collecting them in blocks of fixed sample
-// sizes is possible by using the below class.     ~A
+// Channels of the analyzer capture ring. The input gets tapped before the EQ and
+// the output after it, all four share one write position   ~A
+enum CaptureChannel
+{
+    PreEQLeft,
+    PreEQRight,
+    PostEQLeft,
+    PostEQRight,
+    NumCaptureChannels
+};
 
-template<typename BlockType>
-struct SingleChannelSampleFifo
+// The FFT algorithm requires a fixed number of samples. The host is passing
+// in buffers that vary in sample sizes. Rather than collecting them sample by
+// sample, the audio thread copies whole blocks into the ring below and the GUI
+// reads the samples it needs straight out of it.     ~A
+//
+// Single producer (audio thread), single consumer (GUI). Positions count samples
+// since allocate() and never wrap or go back, the consumer checks after copying
+// whether the producer has lapped it in the meantime.   ~A
+//
+// Every channel sits in its own contiguous lane, so both sides copy whole runs.
+// A block is written as beginWrite(), writeChannel() for each channel, publish().
+// The channels can be filled at different times, e.g. the input before the EQ
+// runs and the output after it, and the reader sees all of them at once   ~A
+
+struct SampleRingBuffer
 {
-    SingleChannelSampleFifo(Channel ch) : channelToUse(ch)
+    SampleRingBuffer()
     {
         prepared.set(false);
     }
 
-    void update(const BlockType& buffer)
+    // From here on the reader treats the next numSamples positions as taken, so
+    // it never trusts anything we're about to overwrite   ~A
+    void beginWrite(int numSamples)
     {
         jassert(prepared.get());
-        jassert(buffer.getNumChannels() > channelToUse);
-        auto* channelPtr = buffer.getReadPointer(channelToUse);
+        pendingSamples = numSamples;
+        reservedPosition.store(writePosition.load(std::memory_order_relaxed) + numSamples, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void writeChannel(int channel, const float* source)
+    {
+        jassert(channel < numChannels);
+        auto position = writePosition.load(std::memory_order_relaxed);
+        auto numSamples = pendingSamples;
+
+        // Anything older than one lap would be overwritten anyway    ~A
+        auto skipped = juce::jmax(0, numSamples - capacity);
+        auto startIndex = (int)((position + skipped) & mask);
+        auto numToCopy = numSamples - skipped;
+        auto firstPart = juce::jmin(numToCopy, capacity - startIndex);
+        auto* lane = getLane(channel);
+
+        std::memcpy(lane + startIndex, source + skipped, (size_t)firstPart * sizeof(float));
+        std::memcpy(lane, source + skipped + firstPart, (size_t)(numToCopy - firstPart) * sizeof(float));
+    }
+
+    void publish()
+    {
+        writePosition.store(writePosition.load(std::memory_order_relaxed) + pendingSamples, std::memory_order_release);
+        pendingSamples = 0;
+    }
+
+    // One whole block in one go, 'sources' holding a pointer for every channel  ~A
+    void write(const float* const* sources, int numSourceChannels, int numSamples)
+    {
+        beginWrite(numSamples);
+        for (int ch = 0; ch < numSourceChannels; ++ch)
+            writeChannel(ch, sources[ch]);
+        publish();
+    }
+
+    // Copies the numSamples of a channel ending at endPosition into dest. Samples
+    // from before the last restart read as silence. Returns false if the audio
+    // thread overwrote any of them before we were done copying   ~A
+    bool read(int channel, float* dest, int numSamples, juce::int64 endPosition) const
+    {
+        jassert(channel < numChannels);
+        jassert(numSamples <= capacity);
+        auto begin = endPosition - numSamples;
+
+        if (reservedPosition.load(std::memory_order_acquire) - begin > capacity)
+            return false;
+
+        auto numSilent = (int)juce::jlimit((juce::int64)0, (juce::int64)numSamples,
+                                           restartPosition.load(std::memory_order_acquire) - begin);
+        juce::FloatVectorOperations::clear(dest, numSilent);
 
-        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        auto startIndex = (int)((begin + numSilent) & mask);
+        auto numToCopy = numSamples - numSilent;
+        auto firstPart = juce::jmin(numToCopy, capacity - startIndex);
+        const auto* lane = getLane(channel);
+
+        std::memcpy(dest + numSilent, lane + startIndex, (size_t)firstPart * sizeof(float));
+        std::memcpy(dest + numSilent + firstPart, lane, (size_t)(numToCopy - firstPart) * sizeof(float));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return reservedPosition.load(std::memory_order_relaxed) - begin <= capacity;
+    }
+
+    // Sizing the ring for at least minCapacity samples per channel. This is the
+    // only place that (re)allocates, so nobody may be reading or writing meanwhile  ~A
+    void allocate(int channelsToUse, int minCapacity)
+    {
+        prepared.set(false);
+
+        auto newCapacity = juce::nextPowerOfTwo(minCapacity);
+        if (newCapacity != capacity || channelsToUse != numChannels)
         {
-            pushNextSampleIntoFifo(channelPtr[i]);
+            capacity = newCapacity;
+            mask = capacity - 1;
+            numChannels = channelsToUse;
+            samples.allocate((size_t)capacity * (size_t)numChannels, true);
         }
     }
 
+    // Getting ready for the host's new block size without touching the storage or
+    // moving the positions back, so a reader that's in the middle of read() keeps
+    // copying from valid memory. Whatever is in the ring from before reads as
+    // silence from here on, same as after restart()   ~A
     void prepare(int bufferSize)
     {
-        prepared.set(false);
+        jassert(capacity > 0);
         size.set(bufferSize);
-
-        bufferToFill.setSize(1,                 // channel
-            bufferSize,        // num samples
-            false,             // keepExistingContent
-            true,              // clear extra space
-            true);             // avoid reallocating
-        audioBufferFifo.prepare(1, bufferSize);
-        fifoIndex = 0;
+        pendingSamples = 0;
+        restart();
         prepared.set(true);
     }
+
+    // Called by the audio thread when capturing resumes. Whatever is in the
+    // ring from before now is stale and gets read back as silence   ~A
+    void restart()
+    {
+        restartPosition.store(writePosition.load(std::memory_order_relaxed), std::memory_order_release);
+        generation.set(generation.get() + 1);
+    }
     //======================================================
-    int getNumCompleteBuffersAvailable() const { return audioBufferFifo.getNumAvailableForReading(); }
+    juce::int64 getWritePosition() const { return writePosition.load(std::memory_order_acquire); }
     bool isPrepared() const { return prepared.get(); }
     int getSize() const { return size.get(); }
-    //======================================================
-    bool getAudioBuffer(BlockType& buf) { return audioBufferFifo.pull(buf); }
+    int getCapacity() const { return capacity; }
+    int getNumChannels() const { return numChannels; }
+    int getGeneration() const { return generation.get(); }
+
+    static constexpr int maxAnalysisWindow = 1 << 13;
+
+    // Room for the longest analysis window plus a quarter second of audio at
+    // 192 kHz, which leaves the GUI plenty of slack before the audio thread laps it  ~A
+    static constexpr int captureCapacity = maxAnalysisWindow + 192000 / 4;
 private:
-    Channel channelToUse;
-    int fifoIndex = 0;
-    Fifo<BlockType> audioBufferFifo;
-    BlockType bufferToFill;
+    juce::HeapBlock<float> samples;
+    int capacity = 0, mask = 0, numChannels = 0;
+    int pendingSamples = 0;
+    std::atomic<juce::int64> writePosition{ 0 }, reservedPosition{ 0 }, restartPosition{ 0 };
     juce::Atomic<bool> prepared = false;
     juce::Atomic<int> size = 0;
+    juce::Atomic<int> generation = 0;
 
-    void pushNextSampleIntoFifo(float sample)
-    {
-        if (fifoIndex == bufferToFill.getNumSamples())
-        {
-            auto ok = audioBufferFifo.push(bufferToFill);
-
-            juce::ignoreUnused(ok);
-
-            fifoIndex = 0;
-        }
-
-        bufferToFill.setSample(0, fifoIndex, sample);
-        ++fifoIndex;
-    }
+    float* getLane(int channel) const { return samples.get() + (size_t)channel * (size_t)capacity; }
 };
 
 
@@ -162,51 +291,211 @@ enum Slope
     Slope_48
 };
 
+// Declaring enum for the analyzer overlap choices, the hop between two FFT
+// frames is half, a quarter or an eighth of the FFT size     ~A
+enum AnalyzerOverlap
+{
+    Overlap_50,
+    Overlap_75,
+    Overlap_87_5
+};
+
+inline int getAnalyzerHopSize(int fftSize, int overlap)
+{
+    return fftSize >> (overlap + 1);
+}
+
+// Declaring enums for the analyzer ballistics choices    ~A
+enum AnalyzerSmoothing
+{
+    Smoothing_Off,
+    Smoothing_12th,
+    Smoothing_6th,
+    Smoothing_3rd
+};
+
+enum AnalyzerAveraging
+{
+    Averaging_Off,
+    Averaging_Fast,
+    Averaging_Medium,
+    Averaging_Slow
+};
+
+// Which spectra the analyzer shows. All of them come out of the same packed
+// stereo FFT, Sum is the only one drawing a single trace    ~A
+enum AnalyzerMode
+{
+    Mode_LeftRight,
+    Mode_MidSide,
+    Mode_Sum
+};
+
+inline int getAnalyzerNumTraces(int mode)
+{
+    return mode == AnalyzerMode::Mode_Sum ? 1 : 2;
+}
+
+
+
+// Peak bands between the cuts. The first three have knobs in the editor and keep
+// their old spots in the parameter layout, the rest get added after everything
+// else and start out switched off   ~A
+constexpr int maxPeakBands = 24;
+constexpr int numEditorBands = 3;
 
+// The peak bands' parameters, one array per field   ~A
+struct PeakBandSettings
+{
+    std::array<float, maxPeakBands> freq{}, gainDB{}, quality{};
+    std::array<bool, maxPeakBands> bypassed{};
+};
 
 // Adding data structure holding all the EQ parameters      ~A
 struct ChainSettings
 {
-    float band1Freq{ 0 }, band1GainDB{ 0 }, band1Quality{1.f};
-    float band2Freq{ 0 }, band2GainDB{ 0 }, band2Quality{ 1.f };
-    float band3Freq{ 0 }, band3GainDB{ 0 }, band3Quality{ 1.f };
+    PeakBandSettings bands;
     float lowCutFreq{ 0 }, highCutFreq{ 0 };
     float gainDB{ 0 };
     int lowCutSlope{ Slope::Slope_12 }, highCutSlope{ Slope::Slope_12 };
 
-    bool lowCutBypassed{ false }, band1Bypassed{ false }, band2Bypassed{ false },
-        band3Bypassed{ false }, highCutBypassed{ false }, allBypassed{false};
+    bool lowCutBypassed{ false }, highCutBypassed{ false }, allBypassed{false};
 };
 
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts);
 
+// Parameter IDs of a peak band, "Band1 Freq" and so on   ~A
+enum BandField
+{
+    BandFreq,
+    BandGain,
+    BandQuality,
+    BandBypassed,
+    NumBandFields
+};
+
+juce::String getBandParameterID(int band, BandField field);
+
 //          Moved those out of private to pass them to plugin editor to draw the spectrum    ~A
 
  // Creating aliases for convoluted namespaces   ~A
 using Filter = juce::dsp::IIR::Filter<float>;
 using CutFilter = juce::dsp::ProcessorChain<Filter, Filter, Filter, Filter>;                // 4 filters for 4 db/Oct settings  ~A
 using OutputGain = juce::dsp::Gain<float>;
-using MonoChain = juce::dsp::ProcessorChain<CutFilter, Filter, Filter, Filter, CutFilter, OutputGain>;  // whole mono chain
+
+// Biquad coefficients of every peak band, normalised, one array per term   ~A
+struct PeakCoefficients
+{
+    // Writing one band in place, the same formulas as IIR::Coefficients::makePeakFilter()   ~A
+    void setPeak(int band, double sampleRate, float frequency, float quality, float gainDB);
+
+    std::array<float, maxPeakBands> b0{}, b1{}, b2{}, a1{}, a2{};
+};
+
+// All peak bands of one channel as a single cascade. Coefficients and filter state
+// live in arrays indexed by band, and only the bands on the active list run, so
+// the cost follows the bands that are switched on rather than maxPeakBands. A
+// band that gets switched on starts from silence. Nothing allocates after
+// construction, so updating it every few samples is fine   ~A
+struct PeakCascade
+{
+    void prepare(const juce::dsp::ProcessSpec&) { reset(); }
+    void reset();
+
+    template<typename ProcessContext>
+    void process(const ProcessContext& context) noexcept
+    {
+        const auto& inputBlock = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        jassert(inputBlock.getNumChannels() == 1 && outputBlock.getNumChannels() == 1);
+
+        if (context.usesSeparateInputAndOutputBlocks())
+            outputBlock.copyFrom(inputBlock);
+
+        if (context.isBypassed)
+            return;
+
+        auto* samples = outputBlock.getChannelPointer(0);
+        for (int index = 0; index < numActiveBands; ++index)
+            processBand(activeBands[(size_t)index], samples, outputBlock.getNumSamples());
+    }
+
+    // Designing the bands that are on, the rest get switched off   ~A
+    void update(const PeakBandSettings& bands, double sampleRate);
+
+    void setCoefficients(const PeakCoefficients& newCoefficients, const std::array<bool, maxPeakBands>& active);
+
+    // Coefficients and which bands run, the state stays this cascade's own   ~A
+    void copyFrom(const PeakCascade& other);
+
+    bool isBandActive(int band) const { return bandActive[(size_t)band]; }
+    int getNumActiveBands() const { return numActiveBands; }
+    const PeakCoefficients& getCoefficients() const { return coefficients; }
+private:
+    void setActiveBands(const std::array<bool, maxPeakBands>& active);
+    void processBand(int band, float* samples, size_t numSamples) noexcept;
+
+    PeakCoefficients coefficients;
+    std::array<float, maxPeakBands> state1{}, state2{};
+
+    std::array<bool, maxPeakBands> bandActive{};
+    std::array<int, maxPeakBands> activeBands{};
+    int numActiveBands = 0;
+};
+
+using MonoChain = juce::dsp::ProcessorChain<CutFilter, PeakCascade, CutFilter, OutputGain>;  // whole mono chain
 
 // Declaring enum for clarity of filter names   ~A
 enum ChainPositions
 {
     LowCut,
-    Band1,
-    Band2,
-    Band3,
+    Peaks,
     HighCut,
     OutputDB
 };
 
+// The sections of one band that are actually running, as plain b0, b1, b2, a1, a2   ~A
+struct BandSections
+{
+    void add(const Filter& filter);
+    void add(const PeakCoefficients& peaks, int band);
+
+    bool operator==(const BandSections& other) const
+    {
+        return numSections == other.numSections && coefficients == other.coefficients;
+    }
+    bool operator!=(const BandSections& other) const { return !(*this == other); }
+
+    int numSections = 0;
+    std::array<std::array<double, 5>, 4> coefficients{};
+};
+
+// What the audio thread is running, published for the editor to draw. A band
+// switched off has no sections. The whole plugin being bypassed leaves the bands
+// as they are, the curve only gets drawn dimmed then. The version goes up with
+// every change, so the reader can tell whether there's anything new   ~A
+struct CoefficientSnapshot
+{
+    // The low cut, every peak band, then the high cut   ~A
+    static constexpr int numBands = maxPeakBands + 2;
+    static constexpr int lowCutBand = 0, highCutBand = numBands - 1;
+    static constexpr int getPeakBand(int band) { return 1 + band; }
+
+    bool hasSameResponse(const CoefficientSnapshot& other) const
+    {
+        return bands == other.bands && sampleRate == other.sampleRate && allBypassed == other.allBypassed;
+    }
+
+    std::array<BandSections, numBands> bands;
+    double sampleRate = 0;
+    bool allBypassed = false;
+    juce::uint32 version = 0;
+};
+
 using Coefficients = Filter::CoefficientsPtr;
 void updateCoefficients(Coefficients& old, const Coefficients& replacement);
 
 
-Coefficients makeBand1Filter(const ChainSettings& chainSettings, double sampleRate);
-Coefficients makeBand2Filter(const ChainSettings& chainSettings, double sampleRate);
-Coefficients makeBand3Filter(const ChainSettings& chainSettings, double sampleRate);
-
 // Moved all these functions here to make them global   ~A
 
 template<int Index, typename ChainType, typename CoefficientType>
@@ -269,10 +558,98 @@ inline auto makeHighCutFilter(const ChainSettings& chainSettings, double sampleR
                                                                                      2 * (chainSettings.highCutSlope + 1));
 }
 
+// Every coefficient of a chain for the given settings. Designing allocates, so a
+// preset switch does it on the message thread and hands the result over   ~A
+struct ChainDesign
+{
+    ChainSettings settings;
+    PeakCoefficients peaks;
+    juce::ReferenceCountedArray<juce::dsp::IIR::Coefficients<float>> lowCut, highCut;
+};
+
+ChainDesign makeChainDesign(const ChainSettings& chainSettings, double sampleRate);
+
+// Setting a chain up from a design, bypass states included   ~A
+void applyChainDesign(MonoChain& chain, const ChainDesign& design);
+
+// The allocation free way of setting a chain up, writing the coefficients straight
+// into the ones it already holds. Cheap enough to run every few samples while
+// morphing. Every stage has to hold second order coefficients already, which
+// prepareChainStages() sees to before the chain gets prepared   ~A
+void prepareChainStages(MonoChain& chain);
+void updateChainInPlace(MonoChain& chain, const ChainSettings& chainSettings, double sampleRate);
+void copyChainInPlace(MonoChain& destination, const MonoChain& source);
+
+// Two settings to morph between, kept the way they interpolate: frequencies and
+// Qs as logs, gains in dB. A band bypassed at one end sits at 0 dB there and a
+// bypassed cut at the edge of the range, so switching them fades instead of
+// jumping. Slopes and the overall bypass can't blend, they switch halfway   ~A
+struct MorphSettings
+{
+    MorphSettings() = default;
+    MorphSettings(const ChainSettings& from, const ChainSettings& to);
+
+    bool isValid() const { return valid; }
+    ChainSettings at(float position) const;
+private:
+    struct End
+    {
+        ChainSettings settings;
+        std::array<float, maxPeakBands> logBandFreq{}, logBandQuality{}, bandGainDB{};
+        float logLowCutFreq = 0, logHighCutFreq = 0;
+    };
+
+    std::array<End, 2> ends;
+    bool valid = false;
+    bool lowCutBypassed = true, highCutBypassed = true;
+    std::array<bool, maxPeakBands> bandBypassed{};
+};
+
+// A bank of presets in one file, mapped into memory instead of read, so listing
+// thousands of them or loading one never parses anything. The layout, all little
+// endian:
+//     int magic, version, number of presets, values per preset
+//     per preset: int offset and length of its UTF-8 name within the name block
+//     per preset: the plain values, in the order of the processor's preset table
+//     the name block
+// A preset from a bank with fewer values than we have now leaves the rest at their
+// defaults. One bank per process, held through a juce::SharedResourcePointer, used
+// from the message thread only   ~A
+struct PresetBank
+{
+    PresetBank();
+
+    int getNumPresets() const { return numPresets; }
+    juce::String getName(int index) const;
+
+    // Copies the preset's values into 'values', any the preset doesn't have become NaN   ~A
+    void getValues(int index, float* values, int numValues) const;
+
+    // Writes the whole bank again with the new preset at the end and maps it anew   ~A
+    bool addPreset(const juce::String& name, const float* values, int numValues);
+
+    static juce::File getDefaultFile();
+
+    static constexpr int magic = 0x42505145; // "EQPB"   ~A
+    static constexpr int version = 1;
+    static constexpr int headerSize = 4 * (int)sizeof(juce::int32);
+private:
+    void map();
+    juce::int32 readInt(size_t offset) const;
+
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    const char* data = nullptr;
+    size_t dataSize = 0;
+    int numPresets = 0, valuesPerPreset = 0;
+    size_t valuesOffset = 0, namesOffset = 0;
+};
+
 //==============================================================================
 /**
 */
-class EQ_LiteAudioProcessor  : public juce::AudioProcessor
+class EQ_LiteAudioProcessor  : public juce::AudioProcessor,
+                               private juce::AudioProcessorValueTreeState::Listener
 {
 public:
     //==============================================================================
@@ -317,36 +694,138 @@ public:
         createParameterLayout();
     
     juce::AudioProcessorValueTreeState apvts {*this, nullptr, "Parameters", createParameterLayout()};
-    // Creating helpful alias and instances of fifo that's declared on top of .h file   ~A
-    using BlockType = juce::AudioBuffer<float>;
-    SingleChannelSampleFifo<BlockType> leftChannelFifo{ Channel::Left };
-    SingleChannelSampleFifo<BlockType> rightChannelFifo{ Channel::Right };
+    // Creating an instance of the sample ring that's declared on top of .h file.
+    // It holds the input and the output of both channels, see CaptureChannel   ~A
+    SampleRingBuffer analyzerCapture;
+
+    // The editor tells us whether the analyzer is actually on screen, so
+    // headless and closed instances skip the capture entirely   ~A
+    void setAnalyzerShowing(bool isShowing) { analyzerShowing.set(isShowing); }
+
+    // Presets and A/B/C/D comparison, message thread only. A preset holds the EQ
+    // parameters in the order of the preset table in the .cpp, the analyzer
+    // settings stay as they are. Either kind of switch fades over to the new
+    // coefficients, see startSwitchFade(). The first values are the ones presets
+    // held before the extra peak bands, so older banks still line up   ~A
+    static constexpr int numPresetValuesBeforeExtraBands = 20;
+    static constexpr int numPresetValues = numPresetValuesBeforeExtraBands + NumBandFields * (maxPeakBands - numEditorBands);
+    static constexpr int numComparisonSlots = 4;
+    using PresetValues = std::array<float, numPresetValues>;
+
+    PresetBank& getPresetBank() { return *presetBank; }
+    void loadPreset(int index);
+    bool savePreset(const juce::String& name);
+
+    // The current settings stay with the slot that was active, the new slot's come
+    // back. A slot never used before starts as a copy of the current settings   ~A
+    void selectComparisonSlot(int slot);
+    int getComparisonSlot() const { return activeComparisonSlot; }
+
+    // Morphing between two captured settings, 'Morph Position' moves between them
+    // while 'Morph Enabled' is on. Both ends are saved with the state   ~A
+    static constexpr int numMorphEnds = 2;
+    void captureMorphEnd(int end);
+    bool hasMorphEnd(int end) const { return morphEndUsed[(size_t)end]; }
+
+    // Message thread only, the editor being the one reader: the newest coefficients
+    // the audio thread published   ~A
+    const CoefficientSnapshot& getCoefficientSnapshot()
+    {
+        coefficientSnapshots.pull();
+        return coefficientSnapshots.getReadBuffer();
+    }
 
 private:
+    juce::Atomic<bool> analyzerShowing{ false };
+    std::atomic<float>* analyzerEnabled = nullptr;
+    bool analyzerWasCapturing = false;
+    void captureForAnalyzer(int firstCaptureChannel, const juce::AudioBuffer<float>& buffer);
 
     MonoChain leftChain, rightChain;                                                             // 2 mono chains for stereo    ~A
 
-    // Cleaning up the code via helper functions   ~A
-    void updateBand1Filter(const ChainSettings& chainSettings);
-    void updateBand2Filter(const ChainSettings& chainSettings);
-    void updateBand3Filter(const ChainSettings& chainSettings);
-    void updateOutputGain(const ChainSettings& chainSettings);
+    // While switching presets the old coefficients keep running in these, faded out
+    // against the new ones in the main chains. Only the fade pays for both   ~A
+    MonoChain outgoingLeftChain, outgoingRightChain;
+    juce::AudioBuffer<float> outgoingBuffer;
 
+    // A preset or slot switch, designed on the message thread. parameterGeneration
+    // is where the parameters were when it was designed, every change up to there
+    // is in it already   ~A
+    struct PendingSwitch
+    {
+        ChainDesign design;
+        juce::uint32 parameterGeneration = 0;
+    };
+    TripleBuffer<PendingSwitch> pendingSwitches;
+    std::atomic<bool> switchingParameters{ false };
+    int switchFadeLength = 0, switchFadePosition = 0;
+    static constexpr double switchFadeSeconds = 0.03;
+
+    bool isSwitchFading() const { return switchFadePosition < switchFadeLength; }
+    void startSwitchFade(const ChainDesign& design);
+    void mixSwitchFade(juce::AudioBuffer<float>& buffer, int numSamples);
+
+    // Sets the parameters so the host and the editor follow, then designs the switch   ~A
+    void switchToValues(const PresetValues& values);
+    PresetValues getCurrentValues() const;
+
+    // NaN marks a value that's missing, those get the parameter's default   ~A
+    PresetValues withDefaultsFilledIn(const PresetValues& values) const;
+
+    // Every EQ parameter in preset table order, for reading the settings on the
+    // audio thread without looking anything up by name   ~A
+    std::array<std::atomic<float>*, numPresetValues> eqParameters{};
+
+    // The audio thread walks the morph in sub-blocks, ramping the position from
+    // where the last block left it, and redesigns only when it actually moved   ~A
+    static constexpr int morphSubBlockSize = 32;
+    TripleBuffer<MorphSettings> morphSettings;
+    std::atomic<float>* morphEnabled = nullptr;
+    std::atomic<float>* morphPosition = nullptr;
+    bool wasMorphing = false;
+    float lastMorphPosition = 0, appliedMorphPosition = 0;
+
+    bool isMorphEngaged() const;
+    void publishMorphSettings();
+    void processMorphing(juce::dsp::AudioBlock<float>& block, bool morphChanged);
+
+    std::array<PresetValues, numMorphEnds> morphEnds;
+    std::array<bool, numMorphEnds> morphEndUsed{};
+
+    juce::SharedResourcePointer<PresetBank> presetBank;
+    std::array<PresetValues, numComparisonSlots> comparisonSlots;
+    std::array<bool, numComparisonSlots> comparisonSlotUsed{};
+    int activeComparisonSlot = 0;
 
     // Moved the commented out lines to global scope because they're needed for
     // drawing the response curve   ~A
     //using Coefficients = Filter::CoefficientsPtr;
     //static void updateCoefficients(Coefficients& old, const Coefficients& replacement);
 
-
- 
-
-
-    // Refactoring the code even more   ~A
-    void updateLowCutFilters(const ChainSettings& chainSettings);
-    void updateHighCutFilters(const ChainSettings& chainSettings);
+    // Refactoring the code even more, one design for both chains   ~A
     void updateFilters();
 
+    // Counted up by any change to a parameter feeding the filters, the audio thread
+    // only redesigns them at the start of the next block after one.
+    // appliedParameterGeneration is the audio thread's own, the generation its
+    // filters were designed from   ~A
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    std::atomic<juce::uint32> parameterGeneration{ 1 };
+    juce::uint32 appliedParameterGeneration = 0;
+
+    // The binary state: magic, layout version, number of values, then the plain
+    // value of every parameter in the order of the stable ID table in the .cpp.
+    // Sessions saved before it hold the apvts ValueTree and still load   ~A
+    static constexpr int binaryStateMagic = 0x424c5145; // "EQLB"   ~A
+    static constexpr int binaryStateVersion = 3;
+    bool restoreBinaryState(juce::MemoryInputStream& stream);
+
+    // Published from updateFilters() and startSwitchFade(), only when something
+    // actually changed   ~A
+    void publishCoefficients(const ChainSettings& chainSettings);
+    TripleBuffer<CoefficientSnapshot> coefficientSnapshots;
+    CoefficientSnapshot lastPublishedCoefficients;
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EQ_LiteAudioProcessor)
 };
@@ -0,0 +1,279 @@
+/*
+  ==============================================================================
+
+    Console test runner. Checks that the audio thread and the analyzer never
+    touch the heap once they're running, counting every allocation through
+    the replaced operator new from Benchmarks/Source/AllocationCounting.cpp,
+    and that switches reach the coefficients the editor draws.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/PluginEditor.h"
+#include "../../Benchmarks/Source/AllocationCounting.h"
+
+namespace
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+    constexpr int numWarmUpRounds = 64;
+    constexpr int numMeasuredRounds = 256;
+
+    void fillWithNoise(juce::AudioBuffer<float>& buffer, juce::Random& random)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                buffer.setSample(ch, i, random.nextFloat() * 0.5f - 0.25f);
+    }
+
+    // Outside a host nobody sets the rate, prepareToPlay() alone would leave the
+    // filters designed for 0 Hz   ~A
+    void prepare(EQ_LiteAudioProcessor& processor)
+    {
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+    }
+
+    void processBlocks(EQ_LiteAudioProcessor& processor, juce::AudioBuffer<float>& buffer,
+                       juce::Random& random, int numBlocks)
+    {
+        juce::MidiBuffer midi;
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            fillWithNoise(buffer, random);
+            processor.processBlock(buffer, midi);
+        }
+    }
+
+    // Allocations 'function' made on this thread   ~A
+    template<typename Function>
+    juce::uint64 countAllocations(Function&& function)
+    {
+        const auto before = getThreadAllocationCount();
+        function();
+        return getThreadAllocationCount() - before;
+    }
+}
+
+// Fifo<T> swaps items with preallocated slots, so pushing and pulling vectors and
+// polylines of the prepared size never allocates   ~A
+struct FifoAllocationTest : juce::UnitTest
+{
+    FifoAllocationTest() : juce::UnitTest("Fifo allocations", "EQ_Lite") {}
+
+    void runTest() override
+    {
+        beginTest("push and pull of prepared vectors");
+        {
+            Fifo<std::vector<float>> fifo;
+            fifo.prepare(2048);
+
+            std::vector<float> item(2048, 0.f), received(2048, 0.f);
+            bool allArrived = true;
+
+            auto allocations = countAllocations([&]
+            {
+                for (int round = 0; round < numMeasuredRounds; ++round)
+                {
+                    item[0] = (float)round;
+                    allArrived = fifo.push(item) && fifo.pull(received) && received[0] == (float)round && allArrived;
+                }
+            });
+
+            expect(allArrived);
+            expectEquals((int)allocations, 0);
+        }
+
+        beginTest("a full fifo refuses without allocating");
+        {
+            Fifo<Polyline, 4> fifo;
+            fifo.prepareSlots([](Polyline& slot) { slot.reserve(1024); });
+
+            Polyline item;
+            item.reserve(1024);
+
+            int numPushed = 0;
+            auto allocations = countAllocations([&]
+            {
+                for (int i = 0; i < 8; ++i)
+                    numPushed += fifo.push(item) ? 1 : 0;
+            });
+
+            // An AbstractFifo keeps one slot free   ~A
+            expectEquals(numPushed, 3);
+            expectEquals((int)allocations, 0);
+        }
+    }
+};
+
+// processBlock() with the analyzer capturing, after the first blocks settled.
+// Redesigning the filters after a parameter change isn't covered, the cut
+// filter designs still allocate   ~A
+struct ProcessBlockAllocationTest : juce::UnitTest
+{
+    ProcessBlockAllocationTest() : juce::UnitTest("processBlock allocations", "EQ_Lite") {}
+
+    void runTest() override
+    {
+        beginTest("steady state processing");
+
+        EQ_LiteAudioProcessor processor;
+        prepare(processor);
+        processor.setAnalyzerShowing(true);
+
+        auto* gain = processor.apvts.getParameter(getBandParameterID(0, BandGain));
+        gain->setValueNotifyingHost(gain->convertTo0to1(6.f));
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random(29);
+
+        for (int round = 0; round < numWarmUpRounds; ++round)
+        {
+            fillWithNoise(buffer, random);
+            processor.processBlock(buffer, midi);
+        }
+
+        auto allocations = countAllocations([&]
+        {
+            for (int round = 0; round < numMeasuredRounds; ++round)
+            {
+                fillWithNoise(buffer, random);
+                processor.processBlock(buffer, midi);
+            }
+        });
+
+        expectEquals((int)allocations, 0);
+        processor.releaseResources();
+    }
+};
+
+// The analyzer's producer side, which the shared worker runs, and the message
+// thread picking up its paths. Both on this thread here, the counter is per thread   ~A
+struct PathProducerAllocationTest : juce::UnitTest
+{
+    PathProducerAllocationTest() : juce::UnitTest("PathProducer allocations", "EQ_Lite") {}
+
+    void runTest() override
+    {
+        beginTest("steady state analysis");
+
+        EQ_LiteAudioProcessor processor;
+        prepare(processor);
+        processor.setAnalyzerShowing(true);
+
+        PathProducer pathProducer(processor.analyzerCapture);
+        const auto fftBounds = juce::Rectangle<float>(20.f, 5.f, 600.f, 250.f);
+        const auto spectrogramHeight = 120;
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random(30);
+
+        auto runFrame = [&]
+        {
+            fillWithNoise(buffer, random);
+            processor.processBlock(buffer, midi);
+
+            auto settings = getAnalyzerSettings(processor.apvts);
+            return countAllocations([&]
+            {
+                pathProducer.process(fftBounds, spectrogramHeight, sampleRate, settings);
+            });
+        };
+
+        std::vector<juce::PixelARGB> column;
+        column.reserve(SpectrogramColumnGenerator::maxHeight);
+
+        auto pickUp = [&]
+        {
+            return countAllocations([&]
+            {
+                pathProducer.pullLatestPaths();
+                while (pathProducer.pullSpectrogramColumn(column)) {}
+            });
+        };
+
+        for (int round = 0; round < numWarmUpRounds; ++round)
+        {
+            runFrame();
+            pickUp();
+        }
+
+        juce::uint64 producerAllocations = 0, pickUpAllocations = 0;
+        for (int round = 0; round < numMeasuredRounds; ++round)
+        {
+            producerAllocations += runFrame();
+            pickUpAllocations += pickUp();
+        }
+
+        expectEquals((int)producerAllocations, 0);
+        expectEquals((int)pickUpAllocations, 0);
+
+        processor.releaseResources();
+    }
+};
+
+// A slot switch designs its coefficients without going through updateFilters(),
+// the editor still has to get them. Slot B boosts the first band, switching back
+// to A has to publish A's flat curve again, without any other parameter moving   ~A
+struct SwitchPublishingTest : juce::UnitTest
+{
+    SwitchPublishingTest() : juce::UnitTest("Switch publishing", "EQ_Lite") {}
+
+    void runTest() override
+    {
+        beginTest("a comparison slot switch publishes its coefficients");
+
+        EQ_LiteAudioProcessor processor;
+        prepare(processor);
+
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::Random random(31);
+        const auto numBlocksPastFade = 16;
+
+        processBlocks(processor, buffer, random, numBlocksPastFade);
+        const auto slotA = processor.getCoefficientSnapshot();
+
+        processor.selectComparisonSlot(1);
+        auto* gain = processor.apvts.getParameter(getBandParameterID(0, BandGain));
+        gain->setValueNotifyingHost(gain->convertTo0to1(9.f));
+        processBlocks(processor, buffer, random, numBlocksPastFade);
+        const auto slotB = processor.getCoefficientSnapshot();
+
+        expect(!slotB.hasSameResponse(slotA));
+
+        processor.selectComparisonSlot(0);
+        processBlocks(processor, buffer, random, 1);
+        const auto& switched = processor.getCoefficientSnapshot();
+
+        expect(switched.version != slotB.version);
+        expect(switched.hasSameResponse(slotA));
+
+        processor.releaseResources();
+    }
+};
+
+static FifoAllocationTest fifoAllocationTest;
+static ProcessBlockAllocationTest processBlockAllocationTest;
+static PathProducerAllocationTest pathProducerAllocationTest;
+static SwitchPublishingTest switchPublishingTest;
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ignoreUnused(argc, argv);
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("EQ_Lite");
+
+    int numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    return numFailures > 0 ? 1 : 0;
+}